@@ -0,0 +1,35 @@
+/* First-call latency of a few typical queries. BENCH_MODE is `record` to
+   write the precompile statements into BENCH_TRACE, `replay` to replay them
+   with jl_precompile_from/1 first, or `cold`. Run from the repository root:
+   bench/first_call.sh */
+:- (   getenv('BENCH_MODE', record),
+       getenv('BENCH_TRACE', File)
+   ->  create_prolog_flag(jl_trace_compile, File, [])
+   ;   true
+   ).
+:- ['jurassic.pl'].
+
+bench_first_call :-
+    (   getenv('BENCH_MODE', Mode)
+    ->  true
+    ;   Mode = cold
+    ),
+    (   Mode == replay
+    ->  getenv('BENCH_TRACE', File),
+        bench(Mode, precompile, jl_precompile_from(File))
+    ;   true
+    ),
+    bench(Mode, sort, _ := sort(rand(1000))),
+    bench(Mode, reduce, _ := sum(abs2, rand(100))),
+    bench(Mode, maplist, jl_maplist(x ->> x^2 + 1, [1.0, 2.0, 3.0], _)),
+    bench(Mode, string, _ := join(split("a b c"), ",")),
+    bench(Mode, tuple, tuple([_, _]) := extrema([3, 1, 2])).
+
+bench(Mode, Name, Goal) :-
+    get_time(T0),
+    call(Goal),
+    get_time(T1),
+    T is T1 - T0,
+    format("mode=~w bench=~w seconds=~4f~n", [Mode, Name, T]).
+
+:- initialization((bench_first_call, halt), main).
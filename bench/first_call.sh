@@ -0,0 +1,7 @@
+#!/bin/sh
+# Record the precompile statements of bench/first_call.pl once, then compare
+# the first-call latency of a cold session with one that replays them
+trace=${BENCH_TRACE:-/tmp/jurassic_precompile.jl}
+BENCH_MODE=record BENCH_TRACE=$trace swipl bench/first_call.pl > /dev/null
+BENCH_MODE=cold swipl bench/first_call.pl
+BENCH_MODE=replay BENCH_TRACE=$trace swipl bench/first_call.pl
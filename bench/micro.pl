@@ -0,0 +1,81 @@
+/* Micro-benchmarks of the bridge: call latency, list and array conversion
+   throughput, tuple unification, function declaration and symbols. Each
+   result is one line of key=value pairs:
+
+     bench=Name type=Type size=Size iters=N seconds=T ns_per_iter=L elems_per_sec=R
+
+   The largest list size is read from BENCH_MAX_SIZE (default 10^7). Run from
+   the repository root: make bench, or swipl bench/micro.pl */
+:- ['jurassic.pl'].
+
+bench_micro :-
+    (   getenv('BENCH_MAX_SIZE', M)
+    ->  atom_number(M, Max)
+    ;   Max is 10^7
+    ),
+    bench_roundtrip,
+    forall(( member(Type, [int, float, string, nested]),
+             between(1, 7, E),
+             Size is 10^E,
+             Size =< Max
+           ),
+           bench_lists(Type, Size)),
+    bench_tuple,
+    bench_declare,
+    bench_symbol.
+
+/* trivial := round trip */
+bench_roundtrip :-
+    bench(roundtrip, int, 1, _ := 1 + 1).
+
+/* list -> array (assignment to a global) and array -> list */
+bench_lists(Type, Size) :-
+    bench_list(Type, Size, L),
+    bench(list_to_array, Type, Size, bench_arr := L),
+    bench(array_to_list, Type, Size, _ := bench_arr),
+    := bench_arr = nothing,
+    garbage_collect.
+
+bench_list(int, Size, L) :-
+    numlist(1, Size, L).
+bench_list(float, Size, L) :-
+    numlist(1, Size, L0),
+    maplist([I, F]>>(F is I * 0.5), L0, L).
+bench_list(string, Size, L) :-
+    length(L, Size),
+    maplist(=("jurassic"), L).
+% rows of 10 elements, converted to a Matrix
+bench_list(nested, Size, L) :-
+    Rows is Size // 10,
+    numlist(1, 10, Row),
+    length(L, Rows),
+    maplist(=(Row), L).
+
+bench_tuple :-
+    := bench_tuple = tuple([1, 2.0, "three"]),
+    bench(tuple_unify, tuple, 3, tuple([_, _, _]) := bench_tuple).
+
+bench_declare :-
+    Body = [jl_expr(:call, [: (+), :x, 1])],
+    bench(declare_function, function, 1,
+          jl_declare_function(bench_f, [:x], Body)).
+
+% Symbol -> atom and atom -> Symbol -> atom
+bench_symbol :-
+    bench(symbol_to_atom, symbol, 1, _ := :jurassic_bench_symbol),
+    bench(atom_to_symbol, symbol, 1, _ := identity(:jurassic_bench_symbol)).
+
+/* run Goal once to compile, then time Iters runs */
+bench(Name, Type, Size, Goal) :-
+    Iters is max(1, min(10000, 10^6 // Size)),
+    \+ \+ call(Goal),
+    get_time(T0),
+    forall(between(1, Iters, _), Goal),
+    get_time(T1),
+    T is T1 - T0,
+    Latency is T / Iters * 1.0e9,
+    Rate is Size * Iters / max(T, 1.0e-9),
+    format("bench=~w type=~w size=~d iters=~d seconds=~6f ns_per_iter=~0f elems_per_sec=~0f~n",
+           [Name, Type, Size, Iters, T, Latency, Rate]).
+
+:- initialization((bench_micro, halt), main).
@@ -0,0 +1,28 @@
+/* Scaling benchmark of jl_pmap/4 and jl_tmaplist/3, the number of Julia
+   threads is read from BENCH_THREADS. Run from the repository root:
+   bench/pmap.sh, or BENCH_THREADS=4 swipl bench/pmap.pl */
+:- (   getenv('BENCH_THREADS', T)
+   ->  atom_number(T, N),
+       create_prolog_flag(jl_threads, N, [])
+   ;   true
+   ).
+:- ['jurassic.pl'].
+
+bench_pmap :-
+    numlist(1, 1000, L0),
+    maplist([_, 100000]>>true, L0, L),
+    N := 'Threads.nthreads'(),
+    jl_pmap(x ->> sum(sin, 1:x), [10], _), % compile
+    bench(N, pmap, jl_pmap(x ->> sum(sin, 1:x), L, _)),
+    bench(N, pmap_chunk_1, jl_pmap(x ->> sum(sin, 1:x), L, _, [chunk(1)])),
+    bench(N, tmaplist, jl_tmaplist(x ->> sum(sin, 1:x), L, _)),
+    bench(N, maplist, jl_maplist(x ->> sum(sin, 1:x), L, _)).
+
+bench(N, Name, Goal) :-
+    get_time(T0),
+    call(Goal),
+    get_time(T1),
+    T is T1 - T0,
+    format("threads=~d bench=~w seconds=~4f~n", [N, Name, T]).
+
+:- initialization((bench_pmap, halt), main).
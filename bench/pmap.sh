@@ -0,0 +1,8 @@
+#!/bin/sh
+# Run bench/pmap.pl with 1, 2, 4, ... Julia threads up to the number of cores
+cores=$(nproc)
+t=1
+while [ "$t" -le "$cores" ]; do
+    BENCH_THREADS=$t swipl bench/pmap.pl
+    t=$((t * 2))
+done
@@ -0,0 +1,25 @@
+/* Contention benchmark: independent Prolog threads calling Julia.
+   Run from the repository root: swipl bench/threads.pl */
+:- ['jurassic.pl'].
+
+bench_threads :-
+    Calls = 20000,
+    forall(member(N, [1, 2, 4, 8]),
+           bench_threads(N, Calls)).
+
+bench_threads(N, Calls) :-
+    PerThread is Calls // N,
+    length(Ids, N),
+    get_time(T0),
+    maplist([Id]>>thread_create(julia_calls(PerThread), Id), Ids),
+    maplist(thread_join, Ids),
+    get_time(T1),
+    T is T1 - T0,
+    Rate is Calls / T,
+    format("threads=~d calls=~d seconds=~4f calls_per_sec=~0f~n",
+           [N, Calls, T, Rate]).
+
+julia_calls(K) :-
+    forall(between(1, K, I), _ := sqrt(I) + 1).
+
+:- initialization((bench_threads, halt), main).
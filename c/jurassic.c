@@ -1,6 +1,10 @@
+#define _GNU_SOURCE /* dladdr */
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include <dlfcn.h>
+#include <libgen.h>
+#include <pthread.h>
 
 #include "jurassic.h"
 #include <julia_gcext.h>
@@ -21,6 +25,14 @@ static functor_t FUNCTOR_timesequal2; /* *= */
 static functor_t FUNCTOR_dividesequal2; /* /= */
 static functor_t FUNCTOR_powerequal2; /* ^= */
 static functor_t FUNCTOR_expr2; /* jl_expr(head, args) make a julia expression for meta-programming*/
+static functor_t FUNCTOR_array1; /* array(NestedList) N-dimensional array literal */
+static functor_t FUNCTOR_handle1; /* handle(Expr) keep the result as a Julia object handle */
+static functor_t FUNCTOR_assign1; /* := Expr */
+static functor_t FUNCTOR_assign2; /* Lhs := Expr */
+static functor_t FUNCTOR_chunk1; /* chunk(N) mode of jl_map_lists */
+static functor_t FUNCTOR_foreach1; /* foreach(N) mode of jl_map_lists */
+static functor_t FUNCTOR_threshold1; /* threshold(Bytes) of jl_gc_policy */
+static functor_t FUNCTOR_prolog_gc1; /* prolog_gc(Bool) of jl_gc_policy */
 static atom_t ATOM_true;
 static atom_t ATOM_false;
 static atom_t ATOM_nan;
@@ -28,16 +40,390 @@ static atom_t ATOM_nothing;
 static atom_t ATOM_missing;
 static atom_t ATOM_inf;
 static atom_t ATOM_ninf; /* negative infinity */
+static atom_t ATOM_undef; /* uninitialised array elements */
+static atom_t ATOM_jl_error; /* flag, how Julia exceptions are reported */
+static atom_t ATOM_print;
+static atom_t ATOM_fail;
+static atom_t ATOM_jl_threads; /* flag, number of Julia threads */
+
+/* cached julia values, set after jl_init() */
+static jl_value_t *jl_missing_value; /* Base.missing */
+static jl_value_t *jl_missing_type; /* Base.Missing */
+static jl_datatype_t *jl_int128_dtype; /* Core.Int128 */
+static jl_datatype_t *jl_uint128_dtype; /* Core.UInt128 */
+static jl_datatype_t *jl_bigint_dtype; /* Base.BigInt */
+static jl_datatype_t *jl_rational_int64_dtype; /* Rational{Int64} */
+static jl_datatype_t *jl_rational_bigint_dtype; /* Rational{BigInt} */
+static jl_function_t *jl_mpz_realloc2_func; /* Base.GMP.MPZ.realloc2 */
+static jl_function_t *jl_convert_func; /* Base.convert */
+static jl_function_t *jl_map_func; /* Base.map */
+static jl_function_t *jl_copy_func; /* Base.copy */
+static jl_function_t *jl_tmap_func; /* Jurassic.tmap, threaded map */
+static jl_function_t *jl_pmap_func; /* Jurassic.pmap, chunked threaded map */
+static jl_function_t *jl_pforeach_func; /* Jurassic.pforeach */
+static jl_function_t *jl_iterate_func; /* Base.iterate */
+static jl_function_t *jl_gc_counts_func; /* Jurassic.gc_counts */
+static jl_function_t *jl_check_globals_func; /* Jurassic.check_globals */
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Performance counters and tracing
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Counters and per-stage timers of jl_stats/1 and the events of jl_trace/1,
+   they cost one branch on "instrument" while both are off. The stage times
+   are exclusive: a stage entered within another one, e.g. an evaluation
+   inside a conversion, pauses the outer stage's timer. Trace events are
+   recorded when a stage is left, with its inclusive duration. */
+#define INSTRUMENT_STATS 1
+#define INSTRUMENT_TRACE 2
+
+typedef enum {
+  STAT_TERMS,      /* Prolog terms converted by pl_to_jl */
+  STAT_ELEMENTS,   /* list and array elements converted in either direction */
+  STAT_ALLOCATED,  /* Julia values and arrays allocated by the conversions */
+  STAT_UNIFIED,    /* Julia values unified by jl_unify_pl */
+  STAT_EXCEPTIONS, /* Julia exceptions */
+  STAT_COUNTERS
+} stat_counter_t;
+
+typedef enum {
+  STAGE_NONE,
+  STAGE_FOREIGN, /* foreign predicates, outside of the other stages */
+  STAGE_CONVERT, /* Prolog terms to Julia expressions and arrays */
+  STAGE_EVAL,    /* evaluating expressions and calling functions */
+  STAGE_UNIFY,   /* Julia values to Prolog terms */
+  STAGES
+} stat_stage_t;
+
+static const char *stat_counter_names[STAT_COUNTERS] = {
+  "terms", "elements", "allocated", "unified", "exceptions"
+};
+static const char *stat_stage_names[STAGES] = {
+  NULL, "foreign", "convert", "eval", "unify"
+};
+
+/* calls of a foreign predicate, linked into stat_preds at its first call */
+typedef struct stat_pred {
+  const char *name;
+  atom_t atom; /* key of the predicate in jl_stats/1, set when linked */
+  uint64_t calls;
+  int linked;
+  struct stat_pred *next;
+} stat_pred_t;
+
+/* an entered stage, "type" is a static string or a Julia type name */
+typedef struct {
+  stat_stage_t stage;
+  const char *type;
+  uint64_t size;
+  uint64_t start;
+} stat_frame_t;
+
+#define STAT_MAX_DEPTH 64 /* deeper stages are not instrumented */
+
+static int instrument = 0; /* INSTRUMENT_STATS | INSTRUMENT_TRACE */
+static uint64_t stat_counters[STAT_COUNTERS];
+static uint64_t stat_stage_count[STAGES];
+static uint64_t stat_stage_ns[STAGES];
+static stat_pred_t *stat_preds = NULL;
+static atom_t stat_counter_atoms[STAT_COUNTERS]; /* keys of jl_stats/1 */
+static atom_t stat_stage_atoms[STAGES];
+static atom_t ATOM_calls;
+static atom_t ATOM_count;
+static atom_t ATOM_ns;
+static __thread stat_frame_t stat_frames[STAT_MAX_DEPTH]; /* entered stages */
+static __thread int stat_depth = 0;
+static __thread uint64_t stat_since; /* when the innermost stage was resumed */
+
+/* Trace events of a thread, the ring keeps the last TRACE_RING_SIZE ones.
+   Rings are linked into trace_rings for jl_trace_dump/1 and reused after
+   their thread exits. */
+#define TRACE_RING_SIZE 4096
+
+typedef struct {
+  const char *type;
+  uint64_t size;
+  uint64_t start;    /* ns, jl_hrtime() */
+  uint64_t duration; /* ns */
+  uint8_t stage;
+} trace_event_t;
+
+typedef struct trace_ring {
+  int in_use;
+  int thread; /* Prolog thread id */
+  uint64_t head; /* events recorded so far */
+  struct trace_ring *next;
+  trace_event_t events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+static trace_ring_t *trace_rings = NULL;
+static __thread trace_ring_t *trace_ring = NULL;
+static pthread_key_t trace_ring_key; /* releases the ring at thread exit */
+
+#define STAT_ADD(COUNTER, N)                                                \
+  do {                                                                      \
+    if (instrument & INSTRUMENT_STATS)                                      \
+      __atomic_fetch_add(&stat_counters[COUNTER], (N), __ATOMIC_RELAXED);   \
+  } while (0)
+
+/* Instrument the code between STAT_ENTER and STAT_LEAVE as STAGE of the
+   value type TYPE and size SIZE, the int SAVED is the depth of the stage
+   (-1 when not instrumented). JL_CATCH blocks call STAT_UNWIND with the
+   stat_depth read before JL_TRY. */
+#define STAT_ENTER(STAGE, TYPE, SIZE, SAVED)                                \
+  ((SAVED) = instrument ? stat_enter(STAGE, TYPE, SIZE) : -1)
+#define STAT_LEAVE(SAVED)                                                   \
+  do {                                                                      \
+    if ((SAVED) >= 0) {                                                     \
+      stat_leave(SAVED);                                                    \
+      (SAVED) = -1;                                                         \
+    }                                                                       \
+  } while (0)
+#define STAT_UNWIND(DEPTH)                                                  \
+  do {                                                                      \
+    if (stat_depth > (DEPTH))                                               \
+      stat_leave(DEPTH);                                                    \
+  } while (0)
+
+static void release_trace_ring(void *ring) {
+  __atomic_store_n(&((trace_ring_t *) ring)->in_use, FALSE, __ATOMIC_RELEASE);
+}
+
+/* the ring of this thread, a released one or a new one */
+static trace_ring_t *get_trace_ring(void) {
+  if (trace_ring != NULL)
+    return trace_ring;
+  trace_ring_t *ring;
+  for (ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+    if (!__atomic_load_n(&ring->in_use, __ATOMIC_ACQUIRE)
+        && !__atomic_exchange_n(&ring->in_use, TRUE, __ATOMIC_ACQ_REL))
+      break;
+  if (ring == NULL) {
+    ring = calloc(1, sizeof(trace_ring_t));
+    if (ring == NULL)
+      return NULL;
+    ring->in_use = TRUE;
+    ring->next = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&trace_rings, &ring->next, ring, FALSE,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+      ;
+  }
+  ring->thread = PL_thread_self();
+  __atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+  pthread_setspecific(trace_ring_key, ring);
+  trace_ring = ring;
+  return ring;
+}
+
+static void trace_record(const stat_frame_t *f, uint64_t now) {
+  trace_ring_t *ring = get_trace_ring();
+  if (ring == NULL)
+    return;
+  trace_event_t *e = &ring->events[ring->head % TRACE_RING_SIZE];
+  e->type = f->type;
+  e->size = f->size;
+  e->start = f->start;
+  e->duration = now - f->start;
+  e->stage = (uint8_t) f->stage;
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/* charge the time since the last transition to the innermost stage */
+static void stat_charge(uint64_t now) {
+  if ((instrument & INSTRUMENT_STATS) && stat_depth > 0)
+    __atomic_fetch_add(&stat_stage_ns[stat_frames[stat_depth - 1].stage],
+                       now - stat_since, __ATOMIC_RELAXED);
+  stat_since = now;
+}
+
+static int stat_enter(stat_stage_t stage, const char *type, uint64_t size) {
+  if (stat_depth >= STAT_MAX_DEPTH)
+    return -1;
+  uint64_t now = jl_hrtime();
+  stat_charge(now);
+  stat_frame_t *f = &stat_frames[stat_depth];
+  f->stage = stage;
+  f->type = type;
+  f->size = size;
+  f->start = now;
+  if (instrument & INSTRUMENT_STATS)
+    __atomic_fetch_add(&stat_stage_count[stage], 1, __ATOMIC_RELAXED);
+  return stat_depth++;
+}
+
+/* leave the stages entered at "depth" and deeper */
+static void stat_leave(int depth) {
+  uint64_t now = jl_hrtime();
+  while (stat_depth > depth) {
+    stat_charge(now);
+    stat_depth--;
+    if (instrument & INSTRUMENT_TRACE)
+      trace_record(&stat_frames[stat_depth], now);
+  }
+}
+
+static uint64_t term_arity(term_t term) {
+  atom_t name;
+  size_t arity;
+  return PL_get_name_arity(term, &name, &arity) ? arity : 0;
+}
+
+static void stat_call(stat_pred_t *pred) {
+  if (!__atomic_load_n(&pred->linked, __ATOMIC_ACQUIRE)
+      && !__atomic_exchange_n(&pred->linked, TRUE, __ATOMIC_ACQ_REL)) {
+    pred->atom = PL_new_atom(pred->name);
+    pred->next = __atomic_load_n(&stat_preds, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&stat_preds, &pred->next, pred, FALSE,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+      ;
+  }
+  __atomic_fetch_add(&pred->calls, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t stat_load(uint64_t *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/* Write the events of all rings, one line of key=value pairs each. Events
+   recorded while dumping may be torn, turn tracing off to get a snapshot. */
+static void dump_trace(FILE *out) {
+  for (trace_ring_t *ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+       ring; ring = ring->next) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    for (uint64_t i = first; i < head; i++) {
+      trace_event_t *e = &ring->events[i % TRACE_RING_SIZE];
+      fprintf(out, "thread=%d stage=%s type=%s size=%lu start_ns=%lu duration_ns=%lu\n",
+              ring->thread, stat_stage_names[e->stage], e->type,
+              (unsigned long) e->size, (unsigned long) e->start,
+              (unsigned long) e->duration);
+    }
+  }
+}
+
+/* Create the keys of jl_stats/1 once, called by install_jurassic */
+static void init_stat_atoms(void) {
+  for (int c = 0; c < STAT_COUNTERS; c++)
+    stat_counter_atoms[c] = PL_new_atom(stat_counter_names[c]);
+  for (int s = STAGE_NONE + 1; s < STAGES; s++)
+    stat_stage_atoms[s] = PL_new_atom(stat_stage_names[s]);
+  ATOM_calls = PL_new_atom("calls");
+  ATOM_count = PL_new_atom("count");
+  ATOM_ns = PL_new_atom("ns");
+}
+
+/* Unify "dict" with _{calls:_{Pred:N, ...}, terms:N, ...,
+   convert:_{count:N, ns:T}, eval:..., unify:...} */
+static int unify_stats(term_t dict) {
+  atom_t keys[1 + STAT_COUNTERS + STAGES - 1];
+  term_t values = PL_new_term_refs(1 + STAT_COUNTERS + STAGES - 1);
+  size_t n = 0;
+  /* calls per foreign predicate */
+  size_t npreds = 0;
+  for (stat_pred_t *p = __atomic_load_n(&stat_preds, __ATOMIC_ACQUIRE); p; p = p->next)
+    npreds++;
+  atom_t *pred_keys = malloc((npreds + 1) * sizeof(atom_t));
+  if (pred_keys == NULL)
+    return PL_resource_error("memory");
+  term_t pred_values = PL_new_term_refs(npreds + 1);
+  size_t i = 0;
+  for (stat_pred_t *p = __atomic_load_n(&stat_preds, __ATOMIC_ACQUIRE);
+       p && i < npreds; p = p->next, i++) {
+    pred_keys[i] = p->atom;
+    if (!PL_put_int64(pred_values + i, (int64_t) stat_load(&p->calls))) {
+      free(pred_keys);
+      return FALSE;
+    }
+  }
+  keys[n] = ATOM_calls;
+  int rc = PL_put_dict(values + n++, 0, i, pred_keys, pred_values);
+  free(pred_keys);
+  if (!rc)
+    return FALSE;
+  for (int c = 0; c < STAT_COUNTERS; c++) {
+    keys[n] = stat_counter_atoms[c];
+    if (!PL_put_int64(values + n++, (int64_t) stat_load(&stat_counters[c])))
+      return FALSE;
+  }
+  for (int s = STAGE_NONE + 1; s < STAGES; s++) {
+    atom_t stage_keys[2] = { ATOM_count, ATOM_ns };
+    term_t stage_values = PL_new_term_refs(2);
+    keys[n] = stat_stage_atoms[s];
+    if (!PL_put_int64(stage_values, (int64_t) stat_load(&stat_stage_count[s]))
+        || !PL_put_int64(stage_values + 1, (int64_t) stat_load(&stat_stage_ns[s]))
+        || !PL_put_dict(values + n++, 0, 2, stage_keys, stage_values))
+      return FALSE;
+  }
+  term_t stats = PL_new_term_ref();
+  return PL_put_dict(stats, 0, n, keys, values) && PL_unify(dict, stats);
+}
+
+static void reset_stats(void) {
+  for (int c = 0; c < STAT_COUNTERS; c++)
+    __atomic_store_n(&stat_counters[c], 0, __ATOMIC_RELAXED);
+  for (int s = 0; s < STAGES; s++) {
+    __atomic_store_n(&stat_stage_count[s], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stat_stage_ns[s], 0, __ATOMIC_RELAXED);
+  }
+  for (stat_pred_t *p = __atomic_load_n(&stat_preds, __ATOMIC_ACQUIRE); p; p = p->next)
+    __atomic_store_n(&p->calls, 0, __ATOMIC_RELAXED);
+}
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
    static functions
    - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
-/* Print Julia exceptions */
+/* How Julia exceptions are reported, the jl_error flag */
+typedef enum {
+  JL_ERROR_RAISE, /* error: raise error(julia_error(Type, Handle), _) */
+  JL_ERROR_PRINT, /* print: print with showerror and fail */
+  JL_ERROR_FAIL   /* fail: fail silently */
+} jl_error_mode_t;
+
+static int jl_installed = FALSE; /* errors during install_jurassic are printed */
+
+static jl_error_mode_t julia_error_mode(void) {
+  atom_t mode;
+  if (!jl_installed)
+    return JL_ERROR_PRINT;
+  if (!PL_current_prolog_flag(ATOM_jl_error, PL_ATOM, &mode))
+    return JL_ERROR_RAISE;
+  return mode == ATOM_print ? JL_ERROR_PRINT
+    : mode == ATOM_fail ? JL_ERROR_FAIL
+    : JL_ERROR_RAISE;
+}
+
+/* Julia type name of a value, symbols are never freed */
+static const char *type_name_chars(jl_value_t *val) {
+  return jl_symbol_name(((jl_datatype_t *) jl_typeof(val))->name->name);
+}
+
+static void keep_julia_error(jl_value_t *exc); /* see "Julia errors" */
+
+/* Report the current Julia exception according to the jl_error flag */
 static void jl_throw_exception() {
-  jl_call2(jl_get_function(jl_base_module, "showerror"),
-           jl_stderr_obj(),
-           jl_exception_occurred());
-  jl_printf(jl_stderr_stream(), "\n");
+  STAT_ADD(STAT_EXCEPTIONS, 1);
+  switch (julia_error_mode()) {
+  case JL_ERROR_RAISE:
+    keep_julia_error(jl_exception_occurred());
+    break;
+  case JL_ERROR_PRINT:
+    jl_call2(jl_get_function(jl_base_module, "showerror"),
+             jl_stderr_obj(),
+             jl_exception_occurred());
+    jl_printf(jl_stderr_stream(), "\n");
+    break;
+  case JL_ERROR_FAIL:
+    break;
+  }
+}
+
+/* Functions of the Jurassic module are NULL when julia/jurassic.jl could not
+   be loaded, the predicates using them raise an existence error */
+static int check_jurassic_function(jl_function_t *func, const char *name) {
+  if (func != NULL)
+    return JURASSIC_SUCCESS;
+  term_t culprit = PL_new_term_ref();
+  return PL_put_atom_chars(culprit, name)
+    && PL_existence_error("julia_function", culprit);
 }
 
 /* Adapted from Julia source */
@@ -125,13 +511,12 @@ static int quote_pair(char x, char y) {
 /* Evaluate Julia string (from julia/src/embedding.c) with checking,
    return to a pre-assigned address */
 static int checked_eval_string(const char *code, jl_value_t **ret) {
+  int outer;
+  STAT_ENTER(STAGE_EVAL, "string", strlen(code), outer);
   *ret = jl_eval_string(code);
+  STAT_LEAVE(outer);
   if (jl_exception_occurred()) {
-    // none of these allocate, so a gc-root (JL_GC_PUSH) is not necessary
-    jl_call2(jl_get_function(jl_base_module, "showerror"),
-             jl_stderr_obj(),
-             jl_exception_occurred());
-    jl_printf(jl_stderr_stream(), "\n");
+    jl_throw_exception();
     *ret = NULL;
     return JURASSIC_FAIL;
   }
@@ -140,13 +525,12 @@ static int checked_eval_string(const char *code, jl_value_t **ret) {
 }
 /* Evaluate Julia string with return value */
 static jl_value_t *checked_send_command_str(const char *code) {
+  int outer;
+  STAT_ENTER(STAGE_EVAL, "string", strlen(code), outer);
   jl_value_t *ret = jl_eval_string(code);
+  STAT_LEAVE(outer);
   if (jl_exception_occurred()) {
-    // none of these allocate, so a gc-root (JL_GC_PUSH) is not necessary
-    jl_call2(jl_get_function(jl_base_module, "showerror"),
-             jl_stderr_obj(),
-             jl_exception_occurred());
-    jl_printf(jl_stderr_stream(), "\n");
+    jl_throw_exception();
     return NULL;
   }
   assert(ret && "Missing return value but no exception occurred!");
@@ -155,13 +539,12 @@ static jl_value_t *checked_send_command_str(const char *code) {
 
 /* Evaluate Julia code without return */
 static int checked_jl_command(const char *code) {
+  int outer;
+  STAT_ENTER(STAGE_EVAL, "string", strlen(code), outer);
   jl_eval_string(code);
+  STAT_LEAVE(outer);
   if (jl_exception_occurred()) {
-    // none of these allocate, so a gc-root (JL_GC_PUSH) is not necessary
-    jl_call2(jl_get_function(jl_base_module, "showerror"),
-             jl_stderr_obj(),
-             jl_exception_occurred());
-    jl_printf(jl_stderr_stream(), "\n");
+    jl_throw_exception();
     return JURASSIC_FAIL;
   }
   return JURASSIC_SUCCESS;
@@ -169,25 +552,8 @@ static int checked_jl_command(const char *code) {
 
 /* Check if a variable (atom string) is defined in julia */
 static int jl_is_defined(const char *var) {
-  return jl_get_global(jl_main_module, jl_symbol_lookup(var)) != NULL ? TRUE : FALSE;
-}
-
-/* Get julia variable from string */
-static int jl_access_var(const char *var, jl_value_t **ret) {
-  if (jl_is_defined(var)) {
-    JL_TRY {
-      *ret = jl_get_global(jl_main_module, jl_symbol_lookup(var));
-      jl_exception_clear();
-    } JL_CATCH {
-      jl_task_t *ct = jl_current_task;
-      jl_current_task->ptls->previous_exception = jl_current_exception();
-      jl_throw_exception();
-      *ret = NULL;
-      return JURASSIC_FAIL;
-    }
-  } else
-    return JURASSIC_FAIL;
-  return JURASSIC_SUCCESS;
+  jl_sym_t *sym = jl_symbol_lookup(var);
+  return sym != NULL && jl_get_global(jl_main_module, sym) != NULL ? TRUE : FALSE;
 }
 
 /* Get julia variable from string */
@@ -221,19 +587,38 @@ static int jl_assign_var(const char *var, jl_value_t *val) {
   return JURASSIC_SUCCESS;
 }
 
+/* Converters open a foreign frame around their element loops and recycle it
+   every JURASSIC_FRAME_CHUNK elements, so the term references created by
+   nested conversions do not pile up on the local stack. When "keep" is set
+   the bindings made so far are kept (unification), otherwise the frame is
+   rewound (Prolog to Julia conversion only reads terms). */
+static fid_t frame_chunk_next(fid_t fid, size_t i, int keep) {
+  if ((i + 1) % JURASSIC_FRAME_CHUNK != 0)
+    return fid;
+  if (!keep) {
+    PL_rewind_foreign_frame(fid);
+    return fid;
+  }
+  PL_close_foreign_frame(fid);
+  return PL_open_foreign_frame();
+}
+
 /* Assign Julia expression arguments with Prolog list */
 static int list_to_expr_args(term_t list, jl_expr_t **ex, size_t start, size_t len, int quotenode) {
   term_t arg_term = PL_new_term_ref();
   term_t list_ = PL_copy_term_ref(list);
   size_t i = start;
+  fid_t fid = PL_open_foreign_frame();
   while (PL_get_list(list_, arg_term, list_) && i < start + len) {
     JL_TRY {
 #ifdef JURASSIC_DEBUG
       printf("----    Argument %lu: ", i);
       char *str_arg;
       if (!PL_get_chars(arg_term, &str_arg,
-                        CVT_WRITE|CVT_EXCEPTION|BUF_STACK|REP_UTF8))
+                        CVT_WRITE|CVT_EXCEPTION|BUF_STACK|REP_UTF8)) {
+        PL_close_foreign_frame(fid);
         return JURASSIC_FAIL;
+      }
       printf("%s.\n", str_arg);
 #endif
       jl_expr_t *a_i;
@@ -243,18 +628,22 @@ static int list_to_expr_args(term_t list, jl_expr_t **ex, size_t start, size_t l
         a_i = (jl_expr_t *) jl_new_struct(jl_quotenode_type, compound_to_jl_expr(arg_term));
       if (a_i == NULL) {
         printf("[ERR] Convert term argument %lu failed!\n", i);
+        PL_close_foreign_frame(fid);
         return JURASSIC_FAIL;
       }
       jl_exprargset(*ex, i, a_i);
+      fid = frame_chunk_next(fid, i - start, FALSE);
       i++;
       jl_exception_clear();
     } JL_CATCH {
       jl_task_t *ct = jl_current_task;
       jl_current_task->ptls->previous_exception = jl_current_exception();
       jl_throw_exception();
+      PL_close_foreign_frame(fid);
       return JURASSIC_FAIL;
     }
   }
+  PL_discard_foreign_frame(fid);
   return JURASSIC_SUCCESS;
 }
 
@@ -390,10 +779,15 @@ static int jl_tuple_unify_all(term_t *pl_tuple, jl_value_t *val) {
 #endif
     term_t head = PL_new_term_ref();
     term_t l = PL_copy_term_ref(list);
+    fid_t fid = PL_open_foreign_frame();
     for (size_t i = 0; i < nargs; i++) {
-      if (!PL_unify_list(l, head, l) || !jl_tuple_ref_unify(&head, val, i))
+      if (!PL_unify_list(l, head, l) || !jl_tuple_ref_unify(&head, val, i)) {
+        PL_close_foreign_frame(fid);
         return JURASSIC_FAIL;
+      }
+      fid = frame_chunk_next(fid, i, TRUE);
     }
+    PL_close_foreign_frame(fid);
     return PL_unify_nil(l);
   } else
     return JURASSIC_FAIL;
@@ -437,11 +831,7 @@ static int expr_list_to_func_lines(term_t list, jl_expr_t **ret) {
     j++;
   }
   if (jl_exception_occurred()) {
-    // none of these allocate, so a gc-root (JL_GC_PUSH) is not necessary
-    jl_call2(jl_get_function(jl_base_module, "showerror"),
-             jl_stderr_obj(),
-             jl_exception_occurred());
-    jl_printf(jl_stderr_stream(), "\n");
+    jl_throw_exception();
     return JURASSIC_FAIL;
   }
   return JURASSIC_SUCCESS;
@@ -458,123 +848,2065 @@ static int expr_array_to_func_lines(jl_array_t *array, int len, jl_expr_t **ret)
     j++;
   }
   if (jl_exception_occurred()) {
-    // none of these allocate, so a gc-root (JL_GC_PUSH) is not necessary
-    jl_call2(jl_get_function(jl_base_module, "showerror"),
-             jl_stderr_obj(),
-             jl_exception_occurred());
-    jl_printf(jl_stderr_stream(), "\n");
+    jl_throw_exception();
     return JURASSIC_FAIL;
   }
   return JURASSIC_SUCCESS;
 }
 
-/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-   Dynamic functions
-   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
-/* Prolog atoms to Julia values */
-int atom_to_jl(atom_t atom, jl_value_t **ret, int flag_sym) {
-  const char *a = PL_atom_chars(atom);
-  if (a == NULL) {
-#ifdef JURASSIC_DEBUG
-    printf("Reading string from atom failed!\n");
-#endif
-    *ret = NULL;
-    return JURASSIC_FAIL;
+/* Element kinds of a Prolog list that can be stored unboxed in Julia */
+typedef enum {
+  LIST_ELT_NONE = 0, /* no element seen yet */
+  LIST_ELT_INT,      /* Int64 */
+  LIST_ELT_FLOAT,    /* Float64, including inf/ninf/nan atoms */
+  LIST_ELT_BOOL,     /* Bool, atoms true/false */
+  LIST_ELT_STRING,   /* String */
+  LIST_ELT_ANY       /* mixed or nested, fallback to Vector{Any} */
+} list_elt_t;
+
+/* Kind of a single list element */
+static list_elt_t term_elt_kind(term_t term, int *is_missing) {
+  *is_missing = 0;
+  switch (PL_term_type(term)) {
+  case PL_INTEGER: {
+    int64_t i;
+    return PL_get_int64(term, &i) ? LIST_ELT_INT : LIST_ELT_ANY;
   }
-  JL_TRY {
-    /* if the atom is julia keywords*/
-    if (atom == ATOM_true) {
-#ifdef JURASSIC_DEBUG
-      printf("boolean: true.\n");
-#endif
-      *ret = jl_true;
-    } else if (atom == ATOM_false) {
-#ifdef JURASSIC_DEBUG
-      printf("boolean: false.\n");
-#endif
-      *ret = jl_false;
-    } else if (atom == ATOM_nothing) {
-#ifdef JURASSIC_DEBUG
-      printf("Nothing.\n");
-      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
-      jl_printf(jl_stdout_stream(), "\n");
-#endif
-      *ret = jl_nothing;
-    } else if (atom == ATOM_missing) {
-#ifdef JURASSIC_DEBUG
-      printf("Missing.\n");
-      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
-      jl_printf(jl_stdout_stream(), "\n");
-#endif
-      *ret = jl_eval_string("missing");
-    }  else if (atom == ATOM_nan) {
-#ifdef JURASSIC_DEBUG
-      printf("NaN.\n");
-      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
-      jl_printf(jl_stdout_stream(), "\n");
-#endif
-      *ret = jl_box_float64(D_PNAN);
-    } else if (atom == ATOM_inf) {
-#ifdef JURASSIC_DEBUG
-      printf("Inf.\n");
-      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
-      jl_printf(jl_stdout_stream(), "\n");
-#endif
-      *ret = jl_box_float64(D_PINF);
-    } else if (atom == ATOM_ninf) {
-#ifdef JURASSIC_DEBUG
-      printf("negative Inf.\n");
-      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
-      jl_printf(jl_stdout_stream(), "\n");
-#endif
-      *ret = jl_box_float64(D_NINF);
-    } else if (jl_is_defined(a) && !flag_sym) {
-      /* get the variable assignment according to name */
-#ifdef JURASSIC_DEBUG
-      printf("defined Julia variable.\n");
-      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
-      jl_printf(jl_stdout_stream(), "\n");
-#endif
-      return jl_access_var(a, ret);
-    } else if (strchr(a, '.') != NULL){
-      /* Expression A1.A2 */
-#ifdef JURASSIC_DEBUG
-      printf("dot symbol.\n");
-#endif
-      *ret = jl_dot(a);
-      if (!ret)
+  case PL_FLOAT:
+    return LIST_ELT_FLOAT;
+  case PL_STRING:
+    return LIST_ELT_STRING;
+  case PL_ATOM: {
+    atom_t atom;
+    if (!PL_get_atom(term, &atom))
+      return LIST_ELT_ANY;
+    if (atom == ATOM_missing) {
+      *is_missing = 1;
+      return LIST_ELT_NONE;
+    } else if (atom == ATOM_true || atom == ATOM_false)
+      return LIST_ELT_BOOL;
+    else if (atom == ATOM_inf || atom == ATOM_ninf || atom == ATOM_nan)
+      return LIST_ELT_FLOAT;
+    return LIST_ELT_ANY;
+  }
+  default:
+    return LIST_ELT_ANY;
+  }
+}
+
+/* Scan a proper list once and decide its common element kind, "has_missing"
+   is set when `missing` atoms appear in the list. */
+static list_elt_t list_elt_kind(term_t list, int *has_missing) {
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(list);
+  list_elt_t kind = LIST_ELT_NONE;
+  *has_missing = 0;
+  while (PL_get_list(tail, head, tail)) {
+    int is_missing;
+    list_elt_t k = term_elt_kind(head, &is_missing);
+    if (is_missing) {
+      *has_missing = 1;
+      continue;
+    }
+    if (k == LIST_ELT_ANY || (kind != LIST_ELT_NONE && kind != k))
+      return LIST_ELT_ANY;
+    kind = k;
+  }
+  return kind;
+}
+
+/* Julia element type of a list kind */
+static jl_value_t *list_elt_jl_type(list_elt_t kind) {
+  switch (kind) {
+  case LIST_ELT_INT:
+    return (jl_value_t *) jl_int64_type;
+  case LIST_ELT_FLOAT:
+    return (jl_value_t *) jl_float64_type;
+  case LIST_ELT_BOOL:
+    return (jl_value_t *) jl_bool_type;
+  case LIST_ELT_STRING:
+    return (jl_value_t *) jl_string_type;
+  default:
+    return (jl_value_t *) jl_any_type;
+  }
+}
+
+/* Read a float list element, inf/ninf/nan atoms included */
+static int term_get_float(term_t term, double *f) {
+  atom_t atom;
+  if (PL_get_atom(term, &atom)) {
+    if (atom == ATOM_inf)
+      *f = D_PINF;
+    else if (atom == ATOM_ninf)
+      *f = D_NINF;
+    else if (atom == ATOM_nan)
+      *f = D_PNAN;
+    else
+      return JURASSIC_FAIL;
+    return JURASSIC_SUCCESS;
+  }
+  return PL_get_float(term, f);
+}
+
+/* Box a list element of known kind */
+static jl_value_t *term_box_elt(term_t term, list_elt_t kind) {
+  switch (kind) {
+  case LIST_ELT_INT: {
+    int64_t i;
+    return PL_get_int64(term, &i) ? jl_box_int64(i) : NULL;
+  }
+  case LIST_ELT_FLOAT: {
+    double f;
+    return term_get_float(term, &f) ? jl_box_float64(f) : NULL;
+  }
+  case LIST_ELT_BOOL: {
+    int b;
+    return PL_get_bool(term, &b) ? jl_box_bool(b) : NULL;
+  }
+  case LIST_ELT_STRING: {
+    char *str;
+    return PL_get_chars(term, &str, CVT_STRING|BUF_STACK|REP_UTF8) ?
+      jl_cstr_to_string(str) : NULL;
+  }
+  default:
+    return NULL;
+  }
+}
+
+/* Allocate an array of type "atype" with "ndims" dimensions */
+static jl_array_t *alloc_array_nd(jl_value_t *atype, const size_t *dims, int ndims) {
+  jl_value_t *dims_tuple = NULL;
+  jl_array_t *arr = NULL;
+  if (ndims == 1)
+    return jl_alloc_array_1d(atype, dims[0]);
+  else if (ndims == 2)
+    return jl_alloc_array_2d(atype, dims[0], dims[1]);
+  else if (ndims == 3)
+    return jl_alloc_array_3d(atype, dims[0], dims[1], dims[2]);
+  JL_GC_PUSH1(&dims_tuple);
+  /* NTuple{N, Int} of dimensions */
+  dims_tuple = jl_new_struct_uninit((jl_datatype_t *)
+                                    jl_tupletype_fill(ndims, (jl_value_t *) jl_long_type));
+  for (int k = 0; k < ndims; k++)
+    ((size_t *) jl_data_ptr(dims_tuple))[k] = dims[k];
+  arr = jl_new_array(atype, dims_tuple);
+  JL_GC_POP();
+  return arr;
+}
+
+/* Allocate an array of "ndims" dimensions whose element type is decided by a
+   list kind, Union{Missing, T} when "has_missing" is set. */
+static jl_array_t *alloc_typed_array(list_elt_t kind, int has_missing,
+                                     const size_t *dims, int ndims) {
+  jl_value_t *eltype = list_elt_jl_type(kind);
+  jl_value_t *atype = NULL;
+  jl_array_t *arr = NULL;
+  JL_GC_PUSH2(&eltype, &atype);
+  if (has_missing) {
+    jl_value_t *types[2] = {jl_missing_type, eltype};
+    eltype = jl_type_union(types, 2);
+  }
+  atype = jl_apply_array_type(eltype, ndims);
+  arr = alloc_array_nd(atype, dims, ndims);
+  JL_GC_POP();
+  return arr;
+}
+
+/* Store list element "term" at linear index "i" of an array allocated by
+   alloc_typed_array. Bitstype elements are written into the array buffer
+   without boxing; with "has_missing" the elements are stored by jl_arrayset,
+   which maintains the union selector bytes. */
+static int typed_elt_set(jl_array_t *arr, term_t term, list_elt_t kind,
+                         int has_missing, size_t i, int flag_sym) {
+  void *data = jl_array_data(arr);
+  jl_value_t *elt = NULL;
+  int is_missing = 0;
+  if (has_missing)
+    term_elt_kind(term, &is_missing);
+  if (is_missing) {
+    jl_arrayset(arr, jl_missing_value, i);
+    return JURASSIC_SUCCESS;
+  } else if (!has_missing) {
+    switch (kind) {
+    case LIST_ELT_INT:
+      return PL_get_int64(term, &((int64_t *) data)[i]);
+    case LIST_ELT_FLOAT:
+      return term_get_float(term, &((double *) data)[i]);
+    case LIST_ELT_BOOL: {
+      int b;
+      if (!PL_get_bool(term, &b))
         return JURASSIC_FAIL;
-    } else { /* default as Symbol */
-#ifdef JURASSIC_DEBUG
-      printf("Fallback to Symbol.\n");
-#endif
-      *ret = (jl_value_t *) jl_symbol(a);
+      ((uint8_t *) data)[i] = (uint8_t) b;
+      return JURASSIC_SUCCESS;
+    }
+    default:
+      break;
     }
-    jl_exception_clear();
-  } JL_CATCH {
-    jl_task_t *ct = jl_current_task;
-    jl_current_task->ptls->previous_exception = jl_current_exception();
-    *ret = NULL;
-    return JURASSIC_FAIL;
   }
+  if (kind == LIST_ELT_ANY) {
+    if (!pl_to_jl(term, &elt, flag_sym))
+      return JURASSIC_FAIL;
+  } else
+    elt = term_box_elt(term, kind);
+  if (elt == NULL)
+    return JURASSIC_FAIL;
+  jl_arrayset(arr, elt, i);
   return JURASSIC_SUCCESS;
 }
 
-/* convert prolog term to julia expression */
-jl_expr_t *compound_to_jl_expr(term_t expr) {
+/* Convert a homogeneous list of "len" elements to a concretely typed vector */
+static int list_to_typed_jl(term_t list, size_t len, list_elt_t kind,
+                            int has_missing, jl_value_t **ret) {
+  jl_array_t *arr = alloc_typed_array(kind, has_missing, &len, 1);
+  JL_GC_PUSH1(&arr);
+
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(list);
+  size_t i = 0;
+  fid_t fid = PL_open_foreign_frame();
+  while (PL_get_list(tail, head, tail) && i < len) {
+    if (!typed_elt_set(arr, head, kind, has_missing, i, TRUE)) {
 #ifdef JURASSIC_DEBUG
-  char *str_expr;
-  if (!PL_get_chars(expr, &str_expr,
-                    CVT_WRITE|CVT_EXCEPTION|BUF_STACK|REP_UTF8))
-    return NULL;
-  printf("[DEBUG] Parse expression: %s\n", str_expr);
+      printf("[DEBUG] Typed list element %lu conversion failed!\n", i);
 #endif
-  /* Treat everthing as Symbols */
+      PL_close_foreign_frame(fid);
+      JL_GC_POP();
+      *ret = NULL;
+      return JURASSIC_FAIL;
+    }
+    fid = frame_chunk_next(fid, i, FALSE);
+    i++;
+  }
+  PL_discard_foreign_frame(fid);
+  *ret = (jl_value_t *) arr;
+  JL_GC_POP();
+  return JURASSIC_SUCCESS;
+}
+
+/* Infer the shape of a nested list by following the first elements, returns
+   the number of dimensions, or 0 when "list" is not a proper list. */
+static int nested_list_shape(term_t list, size_t *dims, int max_dims) {
+  term_t t = PL_copy_term_ref(list);
+  term_t tail = PL_new_term_ref();
+  int ndims = 0;
+  while (PL_is_pair(t) && ndims < max_dims) {
+    size_t len;
+    if (PL_skip_list(t, tail, &len) != PL_LIST)
+      return 0;
+    dims[ndims++] = len;
+    if (!PL_get_head(t, t))
+      return 0;
+  }
+  return ndims;
+}
+
+/* Check that a nested list is rectangular with shape "dims", and collect the
+   common element kind of its leaves. */
+static int nested_list_scan(term_t list, const size_t *dims, int ndims, int dim,
+                            list_elt_t *kind, int *has_missing) {
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(list);
+  term_t rest = PL_new_term_ref();
+  size_t len, i = 0;
+  if (PL_skip_list(tail, rest, &len) != PL_LIST || len != dims[dim])
+    return JURASSIC_FAIL;
+  fid_t fid = PL_open_foreign_frame();
+  while (PL_get_list(tail, head, tail)) {
+    if (dim < ndims - 1) {
+      if (!nested_list_scan(head, dims, ndims, dim + 1, kind, has_missing)) {
+        PL_close_foreign_frame(fid);
+        return JURASSIC_FAIL;
+      }
+      fid = frame_chunk_next(fid, i++, FALSE);
+    } else if (PL_is_pair(head)) {
+      PL_close_foreign_frame(fid);
+      return JURASSIC_FAIL; /* deeper than the inferred shape */
+    } else if (*kind != LIST_ELT_ANY) {
+      int is_missing;
+      list_elt_t k = term_elt_kind(head, &is_missing);
+      if (is_missing)
+        *has_missing = 1;
+      else if (k == LIST_ELT_ANY || (*kind != LIST_ELT_NONE && *kind != k))
+        *kind = LIST_ELT_ANY;
+      else
+        *kind = k;
+    }
+  }
+  PL_discard_foreign_frame(fid);
+  return JURASSIC_SUCCESS;
+}
+
+/* Fill level "dim" of a nested list into the column-major buffer of "arr",
+   the elements of this level start at linear index "offset" and are
+   "strides[dim]" apart. */
+static int nested_list_fill(term_t list, jl_array_t *arr, list_elt_t kind, int has_missing,
+                            const size_t *strides, int ndims, int dim, size_t offset,
+                            int flag_sym) {
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(list);
+  size_t idx = offset;
+  fid_t fid = PL_open_foreign_frame();
+  for (size_t i = 0; PL_get_list(tail, head, tail); i++) {
+    int ok;
+    if (dim < ndims - 1)
+      ok = nested_list_fill(head, arr, kind, has_missing, strides, ndims, dim + 1, idx, flag_sym);
+    else
+      ok = typed_elt_set(arr, head, kind, has_missing, idx, flag_sym);
+    if (!ok) {
+      PL_close_foreign_frame(fid);
+      return JURASSIC_FAIL;
+    }
+    fid = frame_chunk_next(fid, i, FALSE);
+    idx += strides[dim];
+  }
+  PL_discard_foreign_frame(fid);
+  return JURASSIC_SUCCESS;
+}
+
+/* Convert a rectangular nested list to Array{T,N} in one pass, see
+   nested_list_fill for the memory layout. */
+static int nested_list_to_jl(term_t list, const size_t *dims, int ndims,
+                             list_elt_t kind, int has_missing,
+                             jl_value_t **ret, int flag_sym) {
+  if (kind == LIST_ELT_NONE)
+    kind = LIST_ELT_ANY; /* only missing leaves */
+  size_t strides[JURASSIC_MAX_DIMS];
+  strides[0] = 1;
+  for (int k = 1; k < ndims; k++)
+    strides[k] = strides[k-1] * dims[k-1];
+  jl_array_t *arr = alloc_typed_array(kind, has_missing, dims, ndims);
+  JL_GC_PUSH1(&arr);
+  if (!nested_list_fill(list, arr, kind, has_missing, strides, ndims, 0, 0, flag_sym)) {
+#ifdef JURASSIC_DEBUG
+    printf("[DEBUG] Nested list conversion failed!\n");
+#endif
+    JL_GC_POP();
+    *ret = NULL;
+    return JURASSIC_FAIL;
+  }
+  *ret = (jl_value_t *) arr;
+  JL_GC_POP();
+  return JURASSIC_SUCCESS;
+}
+
+/* Put a float into a term, mapping infinities and NaN to atoms */
+static int put_float_or_atom(term_t term, double f) {
+  if (f == D_PINF)
+    return PL_put_atom(term, ATOM_inf);
+  else if (f == D_NINF)
+    return PL_put_atom(term, ATOM_ninf);
+  else if (isnan(f))
+    return PL_put_atom(term, ATOM_nan);
+  return PL_put_float(term, f);
+}
+
+/* Test if a 1-D array can be unified as a list by reading its raw buffer */
+static int is_bits_list_array(jl_array_t *arr) {
+  jl_value_t *eltype = jl_array_eltype((jl_value_t *) arr);
+  return eltype == (jl_value_t *) jl_float64_type ||
+    eltype == (jl_value_t *) jl_float32_type ||
+    eltype == (jl_value_t *) jl_int64_type ||
+    eltype == (jl_value_t *) jl_int32_type ||
+    eltype == (jl_value_t *) jl_int16_type ||
+    eltype == (jl_value_t *) jl_int8_type ||
+    eltype == (jl_value_t *) jl_uint64_type ||
+    eltype == (jl_value_t *) jl_uint32_type ||
+    eltype == (jl_value_t *) jl_uint16_type ||
+    eltype == (jl_value_t *) jl_uint8_type ||
+    eltype == (jl_value_t *) jl_bool_type;
+}
+
+/* Build the list backwards from the array buffer, one cons cell per element */
+#define BITS_ARRAY_TO_LIST(CTYPE, PUT)                                   \
+  for (size_t i = len; i-- > 0;) {                                       \
+    if (!PUT(head, ((CTYPE *) data)[i]) || !PL_cons_list(list, head, list)) \
+      return JURASSIC_FAIL;                                              \
+  }
+
+/* Unify a bitstype 1-D array with a Prolog list without boxing elements */
+static int bits_array_unify_list(jl_array_t *arr, term_t ret) {
+  jl_value_t *eltype = jl_array_eltype((jl_value_t *) arr);
+  size_t len = jl_array_len(arr);
+  void *data = jl_array_data(arr);
+  term_t list = PL_new_term_ref();
+  term_t head = PL_new_term_ref();
+  PL_put_nil(list);
+  if (eltype == (jl_value_t *) jl_float64_type) {
+    BITS_ARRAY_TO_LIST(double, put_float_or_atom);
+  } else if (eltype == (jl_value_t *) jl_float32_type) {
+    BITS_ARRAY_TO_LIST(float, put_float_or_atom);
+  } else if (eltype == (jl_value_t *) jl_int64_type) {
+    BITS_ARRAY_TO_LIST(int64_t, PL_put_int64);
+  } else if (eltype == (jl_value_t *) jl_int32_type) {
+    BITS_ARRAY_TO_LIST(int32_t, PL_put_int64);
+  } else if (eltype == (jl_value_t *) jl_int16_type) {
+    BITS_ARRAY_TO_LIST(int16_t, PL_put_int64);
+  } else if (eltype == (jl_value_t *) jl_int8_type) {
+    BITS_ARRAY_TO_LIST(int8_t, PL_put_int64);
+  } else if (eltype == (jl_value_t *) jl_uint64_type) {
+    BITS_ARRAY_TO_LIST(uint64_t, PL_put_uint64);
+  } else if (eltype == (jl_value_t *) jl_uint32_type) {
+    BITS_ARRAY_TO_LIST(uint32_t, PL_put_uint64);
+  } else if (eltype == (jl_value_t *) jl_uint16_type) {
+    BITS_ARRAY_TO_LIST(uint16_t, PL_put_uint64);
+  } else if (eltype == (jl_value_t *) jl_uint8_type) {
+    BITS_ARRAY_TO_LIST(uint8_t, PL_put_uint64);
+  } else if (eltype == (jl_value_t *) jl_bool_type) {
+    BITS_ARRAY_TO_LIST(uint8_t, PL_put_bool);
+  } else
+    return JURASSIC_FAIL;
+  return PL_unify(ret, list);
+}
+
+/* Put the bitstype element at linear index "i" of an array into a term */
+static int put_bits_elt(term_t term, jl_value_t *eltype, void *data, size_t i) {
+  if (eltype == (jl_value_t *) jl_float64_type)
+    return put_float_or_atom(term, ((double *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_float32_type)
+    return put_float_or_atom(term, ((float *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_int64_type)
+    return PL_put_int64(term, ((int64_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_int32_type)
+    return PL_put_int64(term, ((int32_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_int16_type)
+    return PL_put_int64(term, ((int16_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_int8_type)
+    return PL_put_int64(term, ((int8_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_uint64_type)
+    return PL_put_uint64(term, ((uint64_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_uint32_type)
+    return PL_put_uint64(term, ((uint32_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_uint16_type)
+    return PL_put_uint64(term, ((uint16_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_uint8_type)
+    return PL_put_uint64(term, ((uint8_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_bool_type)
+    return PL_put_bool(term, ((uint8_t *) data)[i]);
+  return JURASSIC_FAIL;
+}
+
+/* Unify level "dim" of an N-d array with a nested list by walking the
+   column-major strides, the elements of this level start at linear index
+   "offset". Lists are built back to front. */
+static int array_nd_unify_list(jl_array_t *arr, term_t ret, const size_t *strides,
+                               int dim, size_t offset, int bits, int flag_sym) {
+  int ndims = jl_array_ndims(arr);
+  size_t n = jl_array_dim(arr, dim);
+  jl_value_t *eltype = jl_array_eltype((jl_value_t *) arr);
+  void *data = jl_array_data(arr);
+  term_t list = PL_new_term_ref();
+  term_t head = PL_new_term_ref();
+  jl_value_t *elt = NULL;
+  JL_GC_PUSH1(&elt);
+  PL_put_nil(list);
+  fid_t fid = PL_open_foreign_frame();
+  for (size_t i = n; i-- > 0;) {
+    size_t idx = offset + i * strides[dim];
+    int ok;
+    PL_put_variable(head);
+    if (dim < ndims - 1)
+      ok = array_nd_unify_list(arr, head, strides, dim + 1, idx, bits, flag_sym);
+    else if (bits)
+      ok = put_bits_elt(head, eltype, data, idx);
+    else {
+      elt = jl_arrayref(arr, idx);
+      ok = elt != NULL && jl_unify_pl(elt, &head, flag_sym);
+    }
+    if (!ok || !PL_cons_list(list, head, list)) {
+      PL_close_foreign_frame(fid);
+      JL_GC_POP();
+      return JURASSIC_FAIL;
+    }
+    fid = frame_chunk_next(fid, n - 1 - i, TRUE);
+  }
+  PL_close_foreign_frame(fid);
+  JL_GC_POP();
+  return PL_unify(ret, list);
+}
+
+/* Unify an N-d array with nested lists, the first dimension is the outermost
+   list: A[i,j,k] is the k-th element of the j-th element of the i-th element. */
+static int array_nd_unify_pl(jl_array_t *arr, term_t ret, int flag_sym) {
+  int ndims = jl_array_ndims(arr);
+  size_t strides[JURASSIC_MAX_DIMS];
+  if (ndims > JURASSIC_MAX_DIMS)
+    return JURASSIC_FAIL;
+  strides[0] = 1;
+  for (int k = 1; k < ndims; k++)
+    strides[k] = strides[k-1] * jl_array_dim(arr, k-1);
+  if (jl_array_len(arr) == 0)
+    return PL_unify_nil(ret);
+  return array_nd_unify_list(arr, ret, strides, 0, 0, is_bits_list_array(arr), flag_sym);
+}
+
+/* Julia BigInt has the memory layout of mpz_t, but its limbs are owned by
+   the libgmp that Julia loaded, so they are only copied, never reallocated,
+   by the GMP linked with SWI-Prolog. */
+static jl_value_t *mpz_to_jl_bigint(mpz_t z) {
+  size_t nlimbs = mpz_size(z);
+  jl_value_t *big = NULL;
+  JL_GC_PUSH1(&big);
+  if (jl_mpz_realloc2_func != NULL)
+    big = jl_call1(jl_mpz_realloc2_func, jl_box_ulong((nlimbs ? nlimbs : 1) * GMP_NUMB_BITS));
+  if (big == NULL || jl_exception_occurred()
+      || ((__mpz_struct *) jl_data_ptr(big))->_mp_alloc < (int) nlimbs) {
+    /* fallback: parse from hexadecimal digits */
+    char *str = mpz_get_str(NULL, 16, z);
+    void (*gmp_free)(void *, size_t);
+    jl_exception_clear();
+    big = jl_call3(jl_get_function(jl_base_module, "parse"), (jl_value_t *) jl_bigint_dtype,
+                   jl_cstr_to_string(str), jl_box_long(16));
+    mp_get_memory_functions(NULL, NULL, &gmp_free);
+    gmp_free(str, strlen(str) + 1);
+  } else {
+    __mpz_struct *jz = (__mpz_struct *) jl_data_ptr(big);
+    memcpy(jz->_mp_d, mpz_limbs_read(z), nlimbs * sizeof(mp_limb_t));
+    jz->_mp_size = mpz_sgn(z) < 0 ? -(int) nlimbs : (int) nlimbs;
+  }
+  JL_GC_POP();
+  return big;
+}
+
+/* Read a Julia BigInt into "z" by copying its limbs */
+static void jl_bigint_to_mpz(jl_value_t *big, mpz_t z) {
+  __mpz_struct *jz = (__mpz_struct *) jl_data_ptr(big);
+  mpz_t ro;
+  mpz_roinit_n(ro, jz->_mp_d, jz->_mp_size);
+  mpz_set(z, ro);
+}
+
+/* Convert a GMP integer to Julia, Int64 when it fits, otherwise BigInt */
+static jl_value_t *mpz_to_jl(mpz_t z) {
+  if (mpz_fits_slong_p(z))
+    return jl_box_int64(mpz_get_si(z));
+  return mpz_to_jl_bigint(z);
+}
+
+/* Convert a GMP rational to Rational{Int64} when both parts fit, otherwise
+   to Rational{BigInt}. mpq_t is canonical, so the struct is built without
+   calling the normalising constructor. */
+static jl_value_t *mpq_to_jl(mpq_t q) {
+  jl_value_t *num = NULL;
+  jl_value_t *den = NULL;
+  jl_value_t *ret = NULL;
+  JL_GC_PUSH3(&num, &den, &ret);
+  if (mpz_fits_slong_p(mpq_numref(q)) && mpz_fits_slong_p(mpq_denref(q))) {
+    num = jl_box_int64(mpz_get_si(mpq_numref(q)));
+    den = jl_box_int64(mpz_get_si(mpq_denref(q)));
+    ret = jl_new_struct(jl_rational_int64_dtype, num, den);
+  } else {
+    num = mpz_to_jl_bigint(mpq_numref(q));
+    den = mpz_to_jl_bigint(mpq_denref(q));
+    if (num != NULL && den != NULL)
+      ret = jl_new_struct(jl_rational_bigint_dtype, num, den);
+  }
+  JL_GC_POP();
+  return ret;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Julia threads
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+#if JULIA_VERSION_MAJOR > 1 || JULIA_VERSION_MINOR >= 9
+#define JURASSIC_ADOPT_THREADS 1 /* foreign threads can be adopted by Julia */
+#endif
+
+/* Prolog threads are in GC-safe state while they run Prolog code, so that an
+   idle thread never blocks a collection started by another one. Foreign
+   predicates switch to GC-unsafe state for their Julia work, and threads that
+   Julia does not know are adopted when they call Julia for the first time. */
+static int jl_thread_enter(int8_t *gc_state) {
+  if (jl_get_pgcstack() == NULL) {
+#ifdef JURASSIC_ADOPT_THREADS
+    jl_adopt_thread();
+    jl_gc_safe_enter(jl_current_task->ptls);
+#else
+    /* Julia < 1.9 only runs on the thread that loaded the library */
+    term_t thread = PL_new_term_ref();
+    return PL_put_integer(thread, PL_thread_self())
+      && PL_permission_error("call", "julia_from_thread", thread);
+#endif
+  }
+  *gc_state = jl_gc_unsafe_enter(jl_current_task->ptls);
+  return TRUE;
+}
+
+static void jl_thread_leave(int8_t gc_state) {
+  jl_gc_unsafe_leave(jl_current_task->ptls, gc_state);
+}
+
+/* Lock a mutex that other Julia threads may hold while they collect garbage,
+   waiting in GC-safe state avoids a deadlock */
+static void jl_mutex_lock_gc_safe(pthread_mutex_t *lock) {
+  if (pthread_mutex_trylock(lock) == 0)
+    return;
+  jl_ptls_t ptls = jl_current_task->ptls;
+  int8_t gc_state = jl_gc_safe_enter(ptls);
+  pthread_mutex_lock(lock);
+  jl_gc_safe_leave(ptls, gc_state);
+}
+
+/* Foreign predicates registered in install_jurassic are wrapped by
+   NAME_mt, which instruments the call, enters Julia with jl_thread_enter,
+   raises the Julia exception kept by the predicate, if any, and applies the
+   policy of jl_gc_policy/1 */
+#define JL_THREADED(NAME, PARAMS, ARGS)       \
+  static stat_pred_t NAME##_stat = { #NAME }; \
+  static foreign_t NAME##_mt PARAMS {         \
+    int8_t gc_state;                          \
+    int outer;                                \
+    if (instrument & INSTRUMENT_STATS)        \
+      stat_call(&NAME##_stat);                \
+    if (!jl_thread_enter(&gc_state))          \
+      return FALSE;                           \
+    STAT_ENTER(STAGE_FOREIGN, #NAME, 0, outer); \
+    foreign_t rc = NAME ARGS;                 \
+    STAT_LEAVE(outer);                        \
+    if (julia_error != NULL)                  \
+      rc = raise_julia_error(rc);             \
+    if (__atomic_load_n(&gc_policy, __ATOMIC_ACQUIRE)) \
+      run_gc_policy();                        \
+    jl_thread_leave(gc_state);                \
+    return rc;                                \
+  }
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Atom and Symbol cache
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+#define SYM_CACHE_SIZE 1024 /* power of 2 */
+
+/* Direct-mapped caches of atom -> Symbol/binding and Symbol -> atom. Both
+   keep a reference to their atoms, which is dropped when a slot is reused */
+typedef struct atom_sym_entry {
+  atom_t atom;
+  jl_sym_t *sym;
+  jl_binding_t *binding; /* Main.name or Mod.name, NULL if unresolved */
+  jl_binding_t *root; /* binding of "Mod" in Main for dotted names */
+  jl_value_t *root_module; /* value of root when resolved */
+} atom_sym_entry_t;
+
+typedef struct sym_atom_entry {
+  jl_sym_t *sym;
+  atom_t atom;
+} sym_atom_entry_t;
+
+static atom_sym_entry_t atom_sym_cache[SYM_CACHE_SIZE];
+static sym_atom_entry_t sym_atom_cache[SYM_CACHE_SIZE];
+static size_t sym_cache_world = 0; /* world age of the resolved bindings */
+static pthread_mutex_t sym_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static jl_value_t *binding_value(jl_binding_t *b) {
+  return b == NULL ? NULL : jl_atomic_load_relaxed(&b->value);
+}
+
+/* Resolve Mod1.Mod2.name through module bindings only, other dotted names
+   (fields, broadcasting operators) are left to jl_dot */
+static void resolve_dotted_binding(atom_sym_entry_t *e, const char *name) {
+  jl_module_t *mod = jl_main_module;
+  jl_binding_t *root = NULL;
+  const char *start = name;
+  const char *dot;
+  if (jl_is_operator((char *) name))
+    return;
+  while ((dot = strchr(start, '.')) != NULL) {
+    size_t len = dot - start;
+    if (len == 0 || len >= BUFFSIZE)
+      return;
+    char part[len + 1];
+    memcpy(part, start, len);
+    part[len] = '\0';
+    jl_sym_t *sym = jl_symbol_lookup(part);
+    if (sym == NULL)
+      return;
+    jl_binding_t *b = jl_get_binding(mod, sym);
+    jl_value_t *v = binding_value(b);
+    if (v == NULL || !jl_is_module(v))
+      return;
+    if (root == NULL)
+      root = b;
+    mod = (jl_module_t *) v;
+    start = dot + 1;
+  }
+  if (*start == '\0' || jl_symbol_lookup(start) == NULL)
+    return;
+  e->binding = jl_get_binding(mod, jl_symbol_lookup(start));
+  e->root = root;
+  e->root_module = binding_value(root);
+}
+
+/* Cached entry of an atom, bindings are re-resolved after the world age
+   changed (new methods, modules or imports). Called with sym_cache_lock */
+static atom_sym_entry_t *atom_sym_entry(atom_t atom) {
+  size_t world = jl_get_world_counter();
+  if (world != sym_cache_world) {
+    for (size_t i = 0; i < SYM_CACHE_SIZE; i++)
+      atom_sym_cache[i].binding = NULL;
+    sym_cache_world = world;
+  }
+  atom_sym_entry_t *e = &atom_sym_cache[(atom >> 7) & (SYM_CACHE_SIZE - 1)];
+  if (e->atom != atom) {
+    const char *name = PL_atom_chars(atom);
+    if (name == NULL)
+      return NULL;
+    if (e->atom)
+      PL_unregister_atom(e->atom);
+    PL_register_atom(atom);
+    e->atom = atom;
+    e->sym = jl_symbol(name);
+    e->binding = NULL;
+  }
+  if (e->binding == NULL) {
+    /* undefined names are not cached, they may be assigned later */
+    const char *name = jl_symbol_name(e->sym);
+    if (strchr(name, '.') == NULL) {
+      e->binding = jl_get_binding(jl_main_module, e->sym);
+      e->root = NULL;
+    } else
+      resolve_dotted_binding(e, name);
+  }
+  return e;
+}
+
+/* Symbol of an atom */
+static jl_sym_t *atom_to_sym(atom_t atom) {
+  jl_mutex_lock_gc_safe(&sym_cache_lock);
+  atom_sym_entry_t *e = atom_sym_entry(atom);
+  jl_sym_t *sym = e == NULL ? NULL : e->sym;
+  pthread_mutex_unlock(&sym_cache_lock);
+  return sym;
+}
+
+/* Value bound to an atom (name or Mod.name), NULL if it is undefined.
+   Called with sym_cache_lock */
+static jl_value_t *atom_bound_value_locked(atom_t atom) {
+  atom_sym_entry_t *e = atom_sym_entry(atom);
+  if (e == NULL)
+    return NULL;
+  if (e->root != NULL && binding_value(e->root) != e->root_module) {
+    e->binding = NULL; /* the module was redefined */
+    return NULL;
+  }
+  return binding_value(e->binding);
+}
+
+static jl_value_t *atom_bound_value(atom_t atom) {
+  jl_mutex_lock_gc_safe(&sym_cache_lock);
+  jl_value_t *val = atom_bound_value_locked(atom);
+  pthread_mutex_unlock(&sym_cache_lock);
+  return val;
+}
+
+/* Put the atom of a Symbol in a term, the term keeps it alive after the
+   cache slot is reused */
+static int put_sym_atom(term_t term, jl_sym_t *sym) {
+  jl_mutex_lock_gc_safe(&sym_cache_lock);
+  sym_atom_entry_t *e = &sym_atom_cache[((uintptr_t) sym >> 4) & (SYM_CACHE_SIZE - 1)];
+  if (e->sym != sym) {
+    if (e->atom)
+      PL_unregister_atom(e->atom);
+    /* the reference returned by PL_new_atom is owned by the cache */
+    e->atom = PL_new_atom_mbchars(REP_UTF8, (size_t) -1, jl_symbol_name(sym));
+    e->sym = sym;
+  }
+  int rc = PL_put_atom(term, e->atom);
+  pthread_mutex_unlock(&sym_cache_lock);
+  return rc;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Julia garbage collection
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* exported by libjulia, though not all are declared in julia.h */
+JL_DLLEXPORT int64_t jl_gc_live_bytes(void);
+JL_DLLEXPORT int64_t jl_gc_total_bytes(void);
+JL_DLLEXPORT uint64_t jl_gc_total_hrtime(void);
+
+#if JULIA_VERSION_MAJOR > 1 || JULIA_VERSION_MINOR >= 9
+#define JURASSIC_HEAP_SIZE_HINT 1
+JL_DLLEXPORT void jl_gc_set_max_memory(uint64_t max_mem);
+#endif
+
+/* Policy of jl_gc_policy/1: after a foreign predicate, run an incremental
+   collection when gc_threshold bytes were allocated since the last one, or
+   when Prolog's atom garbage collector released Julia handles */
+static int gc_policy = FALSE;               /* one of the two is set */
+static int64_t gc_threshold = 0;
+static int gc_on_prolog_gc = FALSE;
+static int gc_handles_released = FALSE;     /* set by release_jl_handle */
+static int64_t gc_policy_mark = 0;          /* jl_gc_total_bytes() at the last one */
+static uint64_t gc_policy_collections = 0;
+static atom_t gc_stat_atoms[7];             /* keys of jl_gc_stats/1 */
+
+/* Create the keys of jl_gc_stats/1 once, called by install_jurassic */
+static void init_gc_stat_atoms(void) {
+  const char *names[7] = {
+    "live_bytes", "total_bytes", "gc_count", "full_count",
+    "gc_time_ns", "policy_count", "enabled"
+  };
+  for (int k = 0; k < 7; k++)
+    gc_stat_atoms[k] = PL_new_atom(names[k]);
+}
+
+static void run_gc_policy(void) {
+  int released = __atomic_load_n(&gc_on_prolog_gc, __ATOMIC_RELAXED)
+    && __atomic_exchange_n(&gc_handles_released, FALSE, __ATOMIC_RELAXED);
+  int64_t threshold = __atomic_load_n(&gc_threshold, __ATOMIC_RELAXED);
+  int64_t total = jl_gc_total_bytes();
+  if (released
+      || (threshold > 0 && total - __atomic_load_n(&gc_policy_mark, __ATOMIC_RELAXED) >= threshold)) {
+    __atomic_store_n(&gc_policy_mark, total, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&gc_policy_collections, 1, __ATOMIC_RELAXED);
+    jl_gc_collect(JL_GC_INCREMENTAL);
+  }
+}
+
+/* Unify "dict" with the heap statistics of Julia */
+static int unify_gc_stats(term_t dict) {
+  if (!check_jurassic_function(jl_gc_counts_func, "Jurassic.gc_counts"))
+    return JURASSIC_FAIL;
+  jl_value_t *counts = jl_call0(jl_gc_counts_func); /* [pauses, full sweeps] */
+  if (counts == NULL) {
+    jl_throw_exception();
+    return JURASSIC_FAIL;
+  }
+  JL_GC_PUSH1(&counts);
+  int64_t *n = (int64_t *) jl_array_data(counts);
+  term_t values = PL_new_term_refs(7);
+  term_t stats = PL_new_term_ref();
+  int rc = PL_put_int64(values, jl_gc_live_bytes())
+    && PL_put_int64(values + 1, jl_gc_total_bytes())
+    && PL_put_int64(values + 2, n[0])
+    && PL_put_int64(values + 3, n[1])
+    && PL_put_int64(values + 4, (int64_t) jl_gc_total_hrtime())
+    && PL_put_int64(values + 5, (int64_t) __atomic_load_n(&gc_policy_collections, __ATOMIC_RELAXED))
+    && PL_put_atom(values + 6, jl_gc_is_enabled() ? ATOM_true : ATOM_false)
+    && PL_put_dict(stats, 0, 7, gc_stat_atoms, values)
+    && PL_unify(dict, stats);
+  JL_GC_POP();
+  return rc;
+}
+
+/* collect, collect(auto|full|incremental), enable, disable or
+   heap_size_hint(Bytes) */
+static int gc_action(term_t action) {
+  atom_t name;
+  size_t arity;
+  if (!PL_get_name_arity(action, &name, &arity))
+    return PL_type_error("julia_gc_action", action);
+  const char *a = PL_atom_chars(name);
+  term_t arg = PL_new_term_ref();
+  if (arity == 0 && strcmp(a, "collect") == 0) {
+    jl_gc_collect(JL_GC_FULL);
+  } else if (arity == 1 && strcmp(a, "collect") == 0) {
+    char *kind;
+    _PL_get_arg(1, action, arg);
+    if (!PL_get_atom_chars(arg, &kind))
+      return PL_type_error("atom", arg);
+    if (strcmp(kind, "auto") == 0)
+      jl_gc_collect(JL_GC_AUTO);
+    else if (strcmp(kind, "full") == 0)
+      jl_gc_collect(JL_GC_FULL);
+    else if (strcmp(kind, "incremental") == 0)
+      jl_gc_collect(JL_GC_INCREMENTAL);
+    else
+      return PL_domain_error("julia_gc_collection", arg);
+  } else if (arity == 0 && strcmp(a, "enable") == 0) {
+    jl_gc_enable(1);
+  } else if (arity == 0 && strcmp(a, "disable") == 0) {
+    jl_gc_enable(0);
+  } else if (arity == 1 && strcmp(a, "heap_size_hint") == 0) {
+    int64_t bytes;
+    _PL_get_arg(1, action, arg);
+    if (!PL_get_int64_ex(arg, &bytes))
+      return FALSE;
+#ifdef JURASSIC_HEAP_SIZE_HINT
+    jl_gc_set_max_memory((uint64_t) bytes);
+#else
+    /* Julia < 1.9 has no heap size hint */
+    return PL_permission_error("set", "julia_heap_size_hint", arg);
+#endif
+  } else
+    return PL_domain_error("julia_gc_action", action);
+  return JURASSIC_SUCCESS;
+}
+
+/* threshold(Bytes) and prolog_gc(Bool), an empty list turns the policy off */
+static int set_gc_policy(term_t options) {
+  int64_t threshold = 0;
+  int on_prolog_gc = FALSE;
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(options);
+  term_t arg = PL_new_term_ref();
+  while (PL_get_list(tail, head, tail)) {
+    if (PL_is_functor(head, FUNCTOR_threshold1)) {
+      _PL_get_arg(1, head, arg);
+      if (!PL_get_int64_ex(arg, &threshold))
+        return FALSE;
+    } else if (PL_is_functor(head, FUNCTOR_prolog_gc1)) {
+      _PL_get_arg(1, head, arg);
+      if (!PL_get_bool_ex(arg, &on_prolog_gc))
+        return FALSE;
+    } else
+      return PL_domain_error("julia_gc_policy", head);
+  }
+  if (!PL_get_nil(tail))
+    return PL_type_error("list", options);
+  __atomic_store_n(&gc_threshold, threshold, __ATOMIC_RELAXED);
+  __atomic_store_n(&gc_on_prolog_gc, on_prolog_gc, __ATOMIC_RELAXED);
+  __atomic_store_n(&gc_policy_mark, jl_gc_total_bytes(), __ATOMIC_RELAXED);
+  __atomic_store_n(&gc_policy, threshold > 0 || on_prolog_gc, __ATOMIC_RELEASE);
+  return JURASSIC_SUCCESS;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Julia object handles
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* A Julia value referenced by a Prolog blob. Live handles are kept in a
+   doubly linked list, which the GC root scanner marks; the blob release
+   callback (Prolog atom GC) unlinks and frees the handle. */
+typedef struct jl_handle {
+  jl_value_t *val;
+  struct jl_handle *prev;
+  struct jl_handle *next;
+} jl_handle_t;
+
+static jl_handle_t *jl_handles = NULL;
+static pthread_mutex_t jl_handles_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Add a handle to the GC roots */
+static void link_jl_handle(jl_handle_t *h) {
+  h->prev = NULL;
+  pthread_mutex_lock(&jl_handles_lock);
+  h->next = jl_handles;
+  if (jl_handles)
+    jl_handles->prev = h;
+  jl_handles = h;
+  pthread_mutex_unlock(&jl_handles_lock);
+}
+
+/* Remove a handle from the GC roots */
+static void unlink_jl_handle(jl_handle_t *h) {
+  pthread_mutex_lock(&jl_handles_lock);
+  if (h->prev)
+    h->prev->next = h->next;
+  else
+    jl_handles = h->next;
+  if (h->next)
+    h->next->prev = h->prev;
+  pthread_mutex_unlock(&jl_handles_lock);
+}
+
+static int release_jl_handle(atom_t a) {
+  jl_handle_t *h = *(jl_handle_t **) PL_blob_data(a, NULL, NULL);
+  unlink_jl_handle(h);
+  free(h);
+  if (__atomic_load_n(&gc_on_prolog_gc, __ATOMIC_RELAXED))
+    __atomic_store_n(&gc_handles_released, TRUE, __ATOMIC_RELAXED);
+  return TRUE;
+}
+
+static int write_jl_handle(IOSTREAM *s, atom_t a, int flags) {
+  jl_handle_t *h = *(jl_handle_t **) PL_blob_data(a, NULL, NULL);
+  Sfprintf(s, "<julia>(%p)", h->val);
+  return TRUE;
+}
+
+static PL_blob_t jl_handle_blob = {
+  PL_BLOB_MAGIC,
+  PL_BLOB_UNIQUE,
+  "julia",
+  release_jl_handle,
+  NULL, /* compare */
+  write_jl_handle,
+  NULL, /* acquire */
+};
+
+/* Julia GC callback, marks the values of all live handles */
+static void jl_handle_root_scanner(int full) {
+  jl_ptls_t ptls = jl_current_task->ptls;
+  pthread_mutex_lock(&jl_handles_lock);
+  for (jl_handle_t *h = jl_handles; h != NULL; h = h->next)
+    jl_gc_mark_queue_obj(ptls, h->val);
+  pthread_mutex_unlock(&jl_handles_lock);
+}
+
+/* Unify a term with a new handle of "val" */
+static int unify_jl_handle(term_t term, jl_value_t *val) {
+  jl_handle_t *h = malloc(sizeof(jl_handle_t));
+  if (h == NULL)
+    return PL_resource_error("memory");
+  h->val = val;
+  link_jl_handle(h);
+  return PL_unify_blob(term, &h, sizeof(h), &jl_handle_blob);
+}
+
+/* Get the Julia value of a handle term */
+static int get_jl_handle(term_t term, jl_value_t **val) {
+  void *data;
+  PL_blob_t *type;
+  if (!PL_get_blob(term, &data, NULL, &type) || type != &jl_handle_blob)
+    return JURASSIC_FAIL;
+  *val = (*(jl_handle_t **) data)->val;
+  return JURASSIC_SUCCESS;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Julia errors
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* The first Julia exception of the running foreign predicate, rooted as a
+   handle until the predicate returns. The message is only formatted when
+   the handle is shown, see jl_error_message/2. */
+static __thread jl_handle_t *julia_error = NULL;
+static __thread int julia_error_goal = 0; /* jl_batch/2 goal that threw */
+
+static void keep_julia_error(jl_value_t *exc) {
+  if (exc == NULL || julia_error != NULL)
+    return;
+  jl_handle_t *h = malloc(sizeof(jl_handle_t));
+  if (h == NULL)
+    return;
+  h->val = exc;
+  link_jl_handle(h);
+  julia_error = h;
+}
+
+/* Raise error(julia_error(Type, Handle), _) for the kept exception when the
+   predicate failed, a predicate that succeeded or raised a Prolog exception
+   drops it. Errors of jl_batch/2 have context(jl_batch/2, goal(I)). */
+static foreign_t raise_julia_error(foreign_t rc) {
+  jl_handle_t *h = julia_error;
+  int goal = julia_error_goal;
+  julia_error = NULL;
+  julia_error_goal = 0;
+  term_t handle = PL_new_term_ref();
+  if (rc || PL_exception(0)
+      || !PL_unify_blob(handle, &h, sizeof(h), &jl_handle_blob)) {
+    unlink_jl_handle(h);
+    free(h);
+    return rc;
+  }
+  term_t ex = PL_new_term_ref();
+  term_t context = PL_new_term_ref();
+  if (goal > 0
+      && !PL_unify_term(context,
+                        PL_FUNCTOR_CHARS, "context", 2,
+                          PL_FUNCTOR_CHARS, "/", 2,
+                            PL_CHARS, "jl_batch",
+                            PL_INT, 2,
+                          PL_FUNCTOR_CHARS, "goal", 1,
+                            PL_INT, goal))
+    return JURASSIC_FAIL;
+  return PL_unify_term(ex,
+                       PL_FUNCTOR_CHARS, "error", 2,
+                         PL_FUNCTOR_CHARS, "julia_error", 2,
+                           PL_UTF8_CHARS, type_name_chars(h->val),
+                           PL_TERM, handle,
+                         PL_TERM, context)
+    && PL_raise_exception(ex);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Native array access
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Get the array referred to by a handle or by the name of a Julia global */
+static int get_jl_array(term_t term, jl_array_t **arr) {
+  jl_value_t *val = NULL;
+  atom_t name;
+  if (!get_jl_handle(term, &val) && PL_get_atom(term, &name))
+    val = jl_get_global(jl_main_module, jl_symbol(PL_atom_chars(name)));
+  if (val == NULL || !jl_is_array(val))
+    return PL_type_error("julia_array", term);
+  *arr = (jl_array_t *) val;
+  return JURASSIC_SUCCESS;
+}
+
+/* Read a list of non-negative integers as array dimensions */
+static int get_array_dims(term_t list, size_t *dims, int *ndims) {
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(list);
+  int64_t d;
+  *ndims = 0;
+  while (PL_get_list(tail, head, tail)) {
+    if (*ndims >= JURASSIC_MAX_DIMS || !PL_get_int64(head, &d) || d < 0)
+      return PL_domain_error("array_dimensions", list);
+    dims[(*ndims)++] = d;
+  }
+  if (!PL_get_nil(tail) || *ndims == 0)
+    return PL_domain_error("array_dimensions", list);
+  return JURASSIC_SUCCESS;
+}
+
+/* Compute the 0-based column-major index of a 1-based index, which is either
+   an integer (linear index) or a list with one integer per dimension */
+static int get_array_index(jl_array_t *arr, term_t index, size_t *lin) {
+  int ndims = jl_array_ndims(arr);
+  int64_t i;
+  if (PL_get_int64(index, &i)) {
+    if (i < 1 || (size_t) i > jl_array_len(arr))
+      return PL_domain_error("array_index", index);
+    *lin = i - 1;
+    return JURASSIC_SUCCESS;
+  }
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(index);
+  size_t stride = 1;
+  int k = 0;
+  *lin = 0;
+  if (PL_get_list(tail, head, tail) && PL_get_nil(tail))
+    return get_array_index(arr, head, lin); /* [I] is a linear index */
+  tail = PL_copy_term_ref(index);
+  while (PL_get_list(tail, head, tail)) {
+    if (k >= ndims || !PL_get_int64(head, &i)
+        || i < 1 || (size_t) i > jl_array_dim(arr, k))
+      return PL_domain_error("array_index", index);
+    *lin += (i - 1) * stride;
+    stride *= jl_array_dim(arr, k);
+    k++;
+  }
+  if (!PL_get_nil(tail) || k != ndims)
+    return PL_domain_error("array_index", index);
+  return JURASSIC_SUCCESS;
+}
+
+/* Store an integer in a narrower element with range check */
+#define GET_RANGED_INT(CTYPE, MIN, MAX) {                         \
+    int64_t v;                                                    \
+    if (!PL_get_int64(term, &v) || v < (MIN) || v > (MAX))        \
+      return JURASSIC_FAIL;                                       \
+    ((CTYPE *) data)[i] = (CTYPE) v;                              \
+    return JURASSIC_SUCCESS;                                      \
+  }
+
+/* Write a term into the bitstype element at linear index "i" of an array,
+   the reverse of put_bits_elt */
+static int get_bits_elt(term_t term, jl_value_t *eltype, void *data, size_t i) {
+  if (eltype == (jl_value_t *) jl_float64_type)
+    return term_get_float(term, &((double *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_float32_type) {
+    double f;
+    if (!term_get_float(term, &f))
+      return JURASSIC_FAIL;
+    ((float *) data)[i] = (float) f;
+    return JURASSIC_SUCCESS;
+  } else if (eltype == (jl_value_t *) jl_int64_type)
+    return PL_get_int64(term, &((int64_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_int32_type)
+    GET_RANGED_INT(int32_t, INT32_MIN, INT32_MAX)
+  else if (eltype == (jl_value_t *) jl_int16_type)
+    GET_RANGED_INT(int16_t, INT16_MIN, INT16_MAX)
+  else if (eltype == (jl_value_t *) jl_int8_type)
+    GET_RANGED_INT(int8_t, INT8_MIN, INT8_MAX)
+  else if (eltype == (jl_value_t *) jl_uint64_type)
+    return PL_get_uint64(term, &((uint64_t *) data)[i]);
+  else if (eltype == (jl_value_t *) jl_uint32_type)
+    GET_RANGED_INT(uint32_t, 0, UINT32_MAX)
+  else if (eltype == (jl_value_t *) jl_uint16_type)
+    GET_RANGED_INT(uint16_t, 0, UINT16_MAX)
+  else if (eltype == (jl_value_t *) jl_uint8_type)
+    GET_RANGED_INT(uint8_t, 0, UINT8_MAX)
+  else if (eltype == (jl_value_t *) jl_bool_type) {
+    int b;
+    if (!PL_get_bool(term, &b))
+      return JURASSIC_FAIL;
+    ((uint8_t *) data)[i] = (uint8_t) b;
+    return JURASSIC_SUCCESS;
+  }
+  return JURASSIC_FAIL;
+}
+
+/* Set the element at linear index "i", bitstype elements are written in
+   place, other values are converted to the element type when needed */
+static int set_array_elt(jl_array_t *arr, term_t term, size_t i) {
+  jl_value_t *eltype = jl_array_eltype((jl_value_t *) arr);
+  if (is_bits_list_array(arr)) {
+    if (!get_bits_elt(term, eltype, jl_array_data(arr), i))
+      return PL_type_error("julia_element", term);
+    return JURASSIC_SUCCESS;
+  }
+  jl_value_t *val = NULL;
+  JL_GC_PUSH1(&val);
+  if (!pl_to_jl(term, &val, FALSE) || val == NULL) {
+    JL_GC_POP();
+    return JURASSIC_FAIL;
+  }
+  if (!jl_isa(val, eltype))
+    val = jl_call2(jl_convert_func, eltype, val);
+  if (val == NULL) {
+    JL_GC_POP();
+    jl_exception_clear();
+    return PL_type_error("julia_element", term);
+  }
+  jl_arrayset(arr, val, i);
+  JL_GC_POP();
+  return JURASSIC_SUCCESS;
+}
+
+/* Unify the element at linear index "i" with a term */
+static int unify_array_elt(jl_array_t *arr, size_t i, term_t term) {
+  if (is_bits_list_array(arr)) {
+    term_t elt = PL_new_term_ref();
+    return put_bits_elt(elt, jl_array_eltype((jl_value_t *) arr), jl_array_data(arr), i)
+      && PL_unify(term, elt);
+  }
+  jl_value_t *val = jl_arrayref(arr, i);
+  int rc;
+  JL_GC_PUSH1(&val);
+  rc = val != NULL && jl_unify_pl(val, &term, 0);
+  JL_GC_POP();
+  return rc;
+}
+
+/* Fill all elements with one value, it is converted only once */
+static int array_fill(jl_array_t *arr, term_t value) {
+  size_t len = jl_array_len(arr);
+  if (len == 0)
+    return JURASSIC_SUCCESS;
+  if (!set_array_elt(arr, value, 0))
+    return JURASSIC_FAIL;
+  if (is_bits_list_array(arr)) {
+    size_t elsize = arr->elsize;
+    char *data = (char *) jl_array_data(arr);
+    for (size_t i = 1; i < len; i++)
+      memcpy(data + i * elsize, data, elsize);
+  } else {
+    jl_value_t *val = jl_arrayref(arr, 0);
+    JL_GC_PUSH1(&val);
+    for (size_t i = 1; i < len; i++)
+      jl_arrayset(arr, val, i);
+    JL_GC_POP();
+  }
+  return JURASSIC_SUCCESS;
+}
+
+/* Allocate Array{eltype, N}, fill it unless "init" is undef */
+static int array_new(term_t name, term_t type, term_t init, term_t size) {
+  size_t dims[JURASSIC_MAX_DIMS];
+  int ndims;
+  atom_t atom;
+  jl_value_t *eltype = NULL;
+  jl_array_t *arr = NULL;
+  int rc = JURASSIC_FAIL;
+  if (!get_array_dims(size, dims, &ndims))
+    return JURASSIC_FAIL;
+  JL_GC_PUSH2(&eltype, &arr);
+  /* type strings and parametric types such as 'Union{Int64, Missing}' are
+     parsed by Julia, plain names are looked up */
+  char *text;
+  int parsed = PL_get_chars(type, &text, CVT_ATOM|CVT_STRING|BUF_STACK|REP_UTF8)
+    && (PL_is_string(type) || strchr(text, '{') != NULL);
+  if (parsed && !checked_eval_string(text, &eltype)) {
+    JL_GC_POP();
+    return JURASSIC_FAIL;
+  }
+  if ((!parsed && !pl_to_jl(type, &eltype, FALSE))
+      || eltype == NULL || !jl_is_type(eltype)) {
+    JL_GC_POP();
+    return PL_type_error("julia_type", type);
+  }
+  arr = alloc_array_nd(jl_apply_array_type(eltype, ndims), dims, ndims);
+  if ((PL_get_atom(init, &atom) && atom == ATOM_undef) || array_fill(arr, init)) {
+    if (PL_is_variable(name))
+      rc = unify_jl_handle(name, (jl_value_t *) arr);
+    else if (PL_get_atom(name, &atom))
+      rc = jl_assign_var(PL_atom_chars(atom), (jl_value_t *) arr);
+    else
+      rc = PL_type_error("atom", name);
+  }
+  JL_GC_POP();
+  return rc;
+}
+
+/* Unify at most "limit" elements from linear offset "offset" with a list */
+static int array_slice(jl_array_t *arr, size_t offset, size_t limit, term_t list) {
+  size_t len = jl_array_len(arr);
+  size_t end = offset >= len ? offset : (limit < len - offset ? offset + limit : len);
+  term_t ret = PL_new_term_ref();
+  term_t head = PL_new_term_ref();
+  PL_put_nil(ret);
+  for (size_t i = end; i-- > offset;) {
+    PL_put_variable(head);
+    if (!unify_array_elt(arr, i, head) || !PL_cons_list(ret, head, ret))
+      return JURASSIC_FAIL;
+  }
+  return PL_unify(list, ret);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Prepared expressions
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Compile "body" into an anonymous function (params...) -> body, where params
+   is a list of atoms standing for the template's variables */
+static int prepare_function(term_t body_pl, term_t params, term_t handle) {
+  int nargs = list_length(params);
+  if (nargs < 0)
+    return JURASSIC_FAIL;
+  jl_expr_t *args = NULL;
+  jl_expr_t *block = NULL;
+  jl_expr_t *lambda = NULL;
+  jl_expr_t *body = NULL;
+  jl_value_t *func = NULL;
+  int rc = JURASSIC_FAIL;
+  JL_GC_PUSH5(&args, &block, &lambda, &body, &func);
+  args = jl_exprn(jl_symbol("tuple"), nargs);
+  if (list_to_expr_args(params, &args, 0, nargs, 0)
+      && (body = compound_to_jl_expr(body_pl)) != NULL) {
+    block = jl_exprn(jl_symbol("block"), 2);
+    jl_exprargset(block, 0, jl_linenumbernode_none(0));
+    jl_exprargset(block, 1, body);
+    lambda = jl_exprn(jl_symbol("->"), 2);
+    jl_exprargset(lambda, 0, args);
+    jl_exprargset(lambda, 1, block);
+#ifdef JURASSIC_DEBUG
+    printf("[DEBUG] Prepared function:\n");
+    jl_static_show(jl_stdout_stream(), (jl_value_t *) lambda);
+    jl_printf(jl_stdout_stream(), "\n");
+#endif
+    func = jl_toplevel_eval_in(jl_main_module, (jl_value_t *) lambda);
+    rc = func != NULL && unify_jl_handle(handle, func);
+  }
+  JL_GC_POP();
+  return rc;
+}
+
+/* Call a prepared function with the converted argument values */
+static int exec_function(term_t handle, term_t args_pl, term_t result) {
+  jl_value_t *func;
+  if (!get_jl_handle(handle, &func))
+    return PL_type_error("julia_handle", handle);
+  int nargs = list_length(args_pl);
+  if (nargs < 0)
+    return JURASSIC_FAIL;
+  jl_value_t **args;
+  JL_GC_PUSHARGS(args, nargs + 1);
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(args_pl);
+  for (int i = 0; PL_get_list(tail, head, tail); i++) {
+    if (!pl_to_jl(head, &args[i], FALSE) || args[i] == NULL) {
+      JL_GC_POP();
+      return JURASSIC_FAIL;
+    }
+  }
+  int outer;
+  STAT_ENTER(STAGE_EVAL, "function", nargs, outer);
+  args[nargs] = jl_call((jl_function_t *) func, args, nargs);
+  STAT_LEAVE(outer);
+  if (args[nargs] == NULL) {
+    if (jl_exception_occurred())
+      jl_throw_exception();
+    JL_GC_POP();
+    return JURASSIC_FAIL;
+  }
+  int rc = jl_unify_pl(args[nargs], &result, 0);
+  JL_GC_POP();
+  return rc;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Direct calls
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Resolve the functor of a plain call f(A1, ..., An) to a function or type
+   bound in Main, NULL if the call has to go through the evaluator. Called
+   with sym_cache_lock */
+static jl_value_t *direct_call_function(term_t term, size_t *arity) {
+  atom_t functor;
+  if (!PL_get_compound_name_arity_sz(term, &functor, arity) || *arity == 0)
+    return NULL;
+  /* meta predicates that are not translated to Expr(:call, ...) */
+  if (PL_is_functor(term, FUNCTOR_field2) || PL_is_functor(term, FUNCTOR_cmd1)
+      || PL_is_functor(term, FUNCTOR_quote1) || PL_is_functor(term, FUNCTOR_quotenode1)
+      || PL_is_functor(term, FUNCTOR_expr2) || PL_is_functor(term, FUNCTOR_macro1)
+      || PL_is_functor(term, FUNCTOR_handle1) || PL_is_functor(term, FUNCTOR_array1)
+      || PL_is_functor(term, FUNCTOR_tuple1) || PL_is_functor(term, FUNCTOR_inline2))
+    return NULL;
+  jl_value_t *f = atom_bound_value_locked(functor);
+  if (f == NULL) {
+    /* Prolog spellings of Julia operators */
+    const char *fname = PL_atom_chars(functor);
+    if (fname != NULL && strcmp(fname, "=<") == 0)
+      f = jl_get_global(jl_main_module, jl_symbol("<="));
+    else if (fname != NULL && strcmp(fname, "\\=") == 0)
+      f = jl_get_global(jl_main_module, jl_symbol("!="));
+  }
+  if (f == NULL || !(jl_is_function(f) || jl_is_type(f)))
+    return NULL;
+  return f;
+}
+
+/* Check (without evaluating anything) that a term is a plain call whose
+   arguments convert to the same values the evaluator would compute. Called
+   with sym_cache_lock */
+static int is_direct_call_locked(term_t term) {
+  size_t arity;
+  if (direct_call_function(term, &arity) == NULL)
+    return FALSE;
+  term_t arg = PL_new_term_ref();
+  for (size_t i = 1; i <= arity; i++) {
+    atom_t atom;
+    int has_missing;
+    list_elt_t kind;
+    jl_value_t *handle;
+    PL_get_arg(i, term, arg);
+    switch (PL_term_type(arg)) {
+    case PL_INTEGER:
+    case PL_FLOAT:
+    case PL_RATIONAL:
+    case PL_STRING:
+      break;
+    case PL_ATOM:
+      /* undefined names are UndefVarErrors for the evaluator */
+      PL_get_atom(arg, &atom);
+      if (atom != ATOM_true && atom != ATOM_false && atom != ATOM_nothing
+          && atom != ATOM_missing && atom != ATOM_nan && atom != ATOM_inf
+          && atom != ATOM_ninf && atom_bound_value_locked(atom) == NULL)
+        return FALSE;
+      break;
+    case PL_LIST_PAIR:
+      /* only typed vectors, :vect would promote mixed elements */
+      kind = list_elt_kind(arg, &has_missing);
+      if (kind == LIST_ELT_NONE || kind == LIST_ELT_ANY)
+        return FALSE;
+      break;
+    case PL_BLOB:
+      if (!get_jl_handle(arg, &handle))
+        return FALSE;
+      break;
+    case PL_TERM:
+      if (!is_direct_call_locked(arg))
+        return FALSE;
+      break;
+    default:
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/* The cache lock is taken once for the whole term */
+static int is_direct_call(term_t term) {
+  jl_mutex_lock_gc_safe(&sym_cache_lock);
+  int rc = is_direct_call_locked(term);
+  pthread_mutex_unlock(&sym_cache_lock);
+  return rc;
+}
+
+/* Apply a term accepted by is_direct_call/1, evaluating nested calls first */
+static int direct_call(term_t term, jl_value_t **ret) {
+  size_t arity;
+  /* bound in Main, so rooted by the module */
+  jl_mutex_lock_gc_safe(&sym_cache_lock);
+  jl_value_t *func = direct_call_function(term, &arity);
+  pthread_mutex_unlock(&sym_cache_lock);
+  if (func == NULL)
+    return JURASSIC_FAIL;
+  jl_value_t **args;
+  JL_GC_PUSHARGS(args, arity + 1);
+  args[0] = func;
+  term_t arg = PL_new_term_ref();
+  for (size_t i = 1; i <= arity; i++) {
+    PL_get_arg(i, term, arg);
+    int ok = PL_term_type(arg) == PL_TERM
+      ? direct_call(arg, &args[i])
+      : pl_to_jl(arg, &args[i], FALSE);
+    if (!ok || args[i] == NULL) {
+      JL_GC_POP();
+      *ret = NULL;
+      return JURASSIC_FAIL;
+    }
+  }
+#ifdef JURASSIC_DEBUG
+  printf("[DEBUG] Direct call/%lu: ", arity);
+  jl_static_show(jl_stdout_stream(), args[0]);
+  jl_printf(jl_stdout_stream(), "\n");
+#endif
+  *ret = jl_call(args[0], &args[1], arity);
+  JL_GC_POP();
+  return *ret != NULL;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Batched evaluation
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Output of a batched goal */
+typedef enum batch_out {
+  BATCH_VALUE,  /* := Expr, the value only goes to Results */
+  BATCH_VAR,    /* Var := Expr */
+  BATCH_HANDLE, /* Var := handle(Expr) */
+  BATCH_GLOBAL  /* name := Expr, assigned to Main.name on success */
+} batch_out_t;
+
+/* Report goal "goal" of jl_batch/2 according to the jl_error flag: raise
+   error(Formal, context(jl_batch/2, goal(I))), print the message or fail */
+static int batch_error(int goal, term_t formal, const char *message) {
+  term_t ex = PL_new_term_ref();
+  switch (julia_error_mode()) {
+  case JL_ERROR_PRINT:
+    printf("[ERR] jl_batch/2: goal %d %s!\n", goal, message);
+    return JURASSIC_FAIL;
+  case JL_ERROR_FAIL:
+    return JURASSIC_FAIL;
+  default:
+    return PL_unify_term(ex,
+                         PL_FUNCTOR_CHARS, "error", 2,
+                           PL_TERM, formal,
+                           PL_FUNCTOR_CHARS, "context", 2,
+                             PL_FUNCTOR_CHARS, "/", 2,
+                               PL_CHARS, "jl_batch",
+                               PL_INT, 2,
+                             PL_FUNCTOR_CHARS, "goal", 1,
+                               PL_INT, goal)
+      && PL_raise_exception(ex);
+  }
+}
+
+/* Translate one goal into "step[] = i; #batchi = rhs", "name" is set to the
+   global assigned by a name := Expr goal */
+static int batch_goal_expr(term_t goal, int i, jl_value_t *step,
+                           jl_value_t *setindex, batch_out_t *out,
+                           jl_sym_t **lhs, jl_sym_t **name_sym,
+                           jl_expr_t **block) {
+  term_t lhs_pl = PL_new_term_ref();
+  term_t rhs_pl = PL_new_term_ref();
+  atom_t name;
+  char tmp[32];
+  if (PL_is_functor(goal, FUNCTOR_assign2)) {
+    _PL_get_arg(1, goal, lhs_pl);
+    _PL_get_arg(2, goal, rhs_pl);
+    if (PL_is_variable(lhs_pl)) {
+      *out = BATCH_VAR;
+      if (PL_is_functor(rhs_pl, FUNCTOR_handle1)) {
+        *out = BATCH_HANDLE;
+        _PL_get_arg(1, rhs_pl, rhs_pl);
+      }
+    } else if (PL_get_atom(lhs_pl, &name)) {
+      if (strncmp(PL_atom_chars(name), "#batch", 6) == 0) {
+        /* bound to the local name by an earlier goal */
+        term_t formal = PL_new_term_ref();
+        return PL_unify_term(formal,
+                             PL_FUNCTOR_CHARS, "uninstantiation_error", 1,
+                               PL_TERM, lhs_pl)
+          && batch_error(i + 1, formal, "reuses an output variable");
+      }
+      *out = BATCH_GLOBAL;
+      *name_sym = atom_to_sym(name);
+      if (*name_sym == NULL)
+        return JURASSIC_FAIL;
+    } else {
+      term_t formal = PL_new_term_ref();
+      return PL_unify_term(formal,
+                           PL_FUNCTOR_CHARS, "domain_error", 2,
+                             PL_CHARS, "jl_batch_goal",
+                             PL_TERM, goal)
+        && batch_error(i + 1, formal,
+                       "only supports Var := Expr or name := Expr");
+    }
+  } else if (PL_is_functor(goal, FUNCTOR_assign1)) {
+    _PL_get_arg(1, goal, rhs_pl);
+    *out = BATCH_VALUE;
+  } else {
+    PL_put_term(rhs_pl, goal);
+    *out = BATCH_VALUE;
+  }
+  snprintf(tmp, sizeof(tmp), "#batch%d", i + 1);
+  *lhs = jl_symbol(tmp);
+  jl_expr_t *mark = NULL;
+  jl_expr_t *assign = NULL;
+  jl_expr_t *rhs = NULL;
+  JL_GC_PUSH3(&mark, &assign, &rhs);
+  rhs = compound_to_jl_expr(rhs_pl);
+  if (rhs == NULL) {
+    /* a Julia error of the conversion is kept and reported for the goal */
+    if (julia_error != NULL)
+      julia_error_goal = i + 1;
+    else if (julia_error_mode() == JL_ERROR_PRINT)
+      printf("[ERR] jl_batch/2: cannot convert goal %d!\n", i + 1);
+    JL_GC_POP();
+    return JURASSIC_FAIL;
+  }
+  mark = jl_exprn(jl_symbol("call"), 3);
+  jl_exprargset(mark, 0, setindex);
+  jl_exprargset(mark, 1, step);
+  jl_exprargset(mark, 2, jl_box_int64(i + 1));
+  assign = jl_exprn(jl_symbol("="), 2);
+  jl_exprargset(assign, 0, *lhs);
+  jl_exprargset(assign, 1, rhs);
+  jl_exprargset(*block, 2 * i, mark);
+  jl_exprargset(*block, 2 * i + 1, assign);
+  JL_GC_POP();
+  /* later goals refer to the output variable by its local name */
+  if (*out == BATCH_VAR || *out == BATCH_HANDLE)
+    return PL_unify_atom_chars(lhs_pl, tmp);
+  return JURASSIC_SUCCESS;
+}
+
+/* Block of the statements [from, to) of the flat batch block, followed by
+   "body" unless it is NULL */
+static jl_expr_t *batch_segment(jl_expr_t *flat, int from, int to, jl_value_t *body) {
+  jl_expr_t *ex = jl_exprn(jl_symbol("block"), to - from + (body != NULL));
+  for (int k = from; k < to; k++)
+    jl_exprargset(ex, k - from, jl_exprarg(flat, k));
+  if (body != NULL)
+    jl_exprargset(ex, to - from, body);
+  return ex;
+}
+
+/* Nest the flat block so that the goals after a name := Expr goal run in
+   "let name = #batchi ... end": they read the new value while earlier goals
+   still read Main.name, and name never becomes a local of the whole block */
+static jl_value_t *batch_nest(jl_expr_t *flat, int n, const batch_out_t *outs,
+                              jl_sym_t **lhs, jl_sym_t **names) {
+  jl_value_t *body = NULL;
+  jl_expr_t *inner = NULL;
+  jl_expr_t *bind = NULL;
+  int end = 2 * n + 1; /* the output tuple is the last statement */
+  JL_GC_PUSH3(&body, &inner, &bind);
+  for (int i = n - 1; i >= 0; i--) {
+    if (outs[i] != BATCH_GLOBAL)
+      continue;
+    inner = batch_segment(flat, 2 * (i + 1), end, body);
+    bind = jl_exprn(jl_symbol("="), 2);
+    jl_exprargset(bind, 0, names[i]);
+    jl_exprargset(bind, 1, lhs[i]);
+    body = (jl_value_t *) jl_exprn(jl_symbol("let"), 2);
+    jl_exprargset(body, 0, bind);
+    jl_exprargset(body, 1, inner);
+    end = 2 * (i + 1);
+  }
+  body = (jl_value_t *) batch_segment(flat, 0, end, body);
+  JL_GC_POP();
+  return body;
+}
+
+/* Check that every name := Expr goal can assign its output before any
+   global is changed, the first one that cannot raises permission_error */
+static int batch_check_globals(int n, const batch_out_t *outs,
+                               jl_sym_t **names, jl_value_t *outputs) {
+  if (!check_jurassic_function(jl_check_globals_func, "Jurassic.check_globals"))
+    return JURASSIC_FAIL;
+  jl_array_t *syms = NULL;
+  jl_value_t *ret = NULL;
+  JL_GC_PUSH2(&syms, &ret);
+  syms = jl_alloc_vec_any(n);
+  for (int i = 0; i < n; i++)
+    jl_array_ptr_set(syms, i, outs[i] == BATCH_GLOBAL
+                     ? (jl_value_t *) names[i] : jl_nothing);
+  volatile int64_t failed = -1;
+  JL_TRY {
+    ret = jl_call2(jl_check_globals_func, (jl_value_t *) syms, outputs);
+    failed = jl_unbox_int64(ret);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+  }
+  JL_GC_POP();
+  if (failed <= 0)
+    return failed == 0;
+  term_t formal = PL_new_term_ref();
+  return PL_unify_term(formal,
+                       PL_FUNCTOR_CHARS, "permission_error", 3,
+                         PL_CHARS, "modify",
+                         PL_CHARS, "julia_global",
+                         PL_UTF8_CHARS, jl_symbol_name(names[failed - 1]))
+    && batch_error((int) failed, formal, "cannot assign its global");
+}
+
+/* Evaluate all goals in one let block, which returns the tuple of their
+   outputs. Every goal assigns a local #batchi, names are only copied to
+   Main after every goal succeeded, the outputs were unified and every name
+   was checked. */
+static int batch_eval(term_t goals, term_t results) {
+  int n = list_length(goals);
+  if (n < 0)
+    return JURASSIC_FAIL;
+  batch_out_t outs[n > 0 ? n : 1];
+  jl_sym_t *lhs[n > 0 ? n : 1];
+  jl_sym_t *names[n > 0 ? n : 1];
+  jl_value_t **roots;
+  JL_GC_PUSHARGS(roots, 5);
+  /* roots[0]: block, roots[1]: step, roots[2]: let, roots[3]: outputs,
+     roots[4]: current output */
+  jl_expr_t **block = (jl_expr_t **) &roots[0];
+  roots[0] = (jl_value_t *) jl_exprn(jl_symbol("block"), 2 * n + 1);
+  roots[1] = jl_call1(jl_get_function(jl_base_module, "Ref"), jl_box_int64(0));
+  jl_value_t *setindex = (jl_value_t *) jl_get_function(jl_base_module, "setindex!");
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(goals);
+  /* output variables are bound to their local names while translating */
+  fid_t fid = PL_open_foreign_frame();
+  for (int i = 0; PL_get_list(tail, head, tail); i++) {
+    if (!batch_goal_expr(head, i, roots[1], setindex, &outs[i], &lhs[i], &names[i], block)) {
+      PL_close_foreign_frame(fid); /* keeps a raised exception */
+      JL_GC_POP();
+      return JURASSIC_FAIL;
+    }
+  }
+  PL_discard_foreign_frame(fid);
+  jl_expr_t *tuple = jl_exprn(jl_symbol("tuple"), n);
+  jl_exprargset(*block, 2 * n, tuple);
+  for (int i = 0; i < n; i++)
+    jl_exprargset(tuple, i, lhs[i]);
+  roots[4] = batch_nest(*block, n, outs, lhs, names);
+  roots[2] = (jl_value_t *) jl_exprn(jl_symbol("let"), 2);
+  jl_exprargset(roots[2], 0, jl_exprn(jl_symbol("block"), 0));
+  jl_exprargset(roots[2], 1, roots[4]);
+#ifdef JURASSIC_DEBUG
+  printf("[DEBUG] Batch:\n");
+  jl_static_show(jl_stdout_stream(), roots[2]);
+  jl_printf(jl_stdout_stream(), "\n");
+#endif
+  int depth = stat_depth;
+  JL_TRY {
+    int outer;
+    STAT_ENTER(STAGE_EVAL, "batch", n, outer);
+    roots[3] = jl_toplevel_eval_in(jl_main_module, roots[2]);
+    STAT_LEAVE(outer);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    STAT_UNWIND(depth);
+    int64_t failed = jl_unbox_int64(jl_get_nth_field(roots[1], 0));
+    if (julia_error_mode() == JL_ERROR_PRINT)
+      printf("[ERR] jl_batch/2: goal %ld failed!\n", (long) failed);
+    jl_throw_exception();
+    if (julia_error != NULL)
+      julia_error_goal = (int) failed;
+    JL_GC_POP();
+    return JURASSIC_FAIL;
+  }
+  /* unify outputs in one pass, globals are untouched until they all unify */
+  term_t goal = PL_new_term_ref();
+  term_t out = PL_new_term_ref();
+  term_t gtail = PL_copy_term_ref(goals);
+  tail = PL_copy_term_ref(results);
+  int rc = JURASSIC_SUCCESS;
+  for (int i = 0; rc && i < n && PL_get_list(gtail, goal, gtail); i++) {
+    roots[4] = jl_get_nth_field(roots[3], i);
+    rc = PL_unify_list(tail, head, tail)
+      && (outs[i] == BATCH_HANDLE
+          ? unify_jl_handle(head, roots[4])
+          : jl_unify_pl(roots[4], &head, 0));
+    if (rc && (outs[i] == BATCH_VAR || outs[i] == BATCH_HANDLE))
+      rc = PL_get_arg(1, goal, out) && PL_unify(out, head);
+  }
+  rc = rc && PL_unify_nil(tail);
+  if (rc && !batch_check_globals(n, outs, names, roots[3]))
+    rc = JURASSIC_FAIL;
+  for (int i = 0; rc && i < n; i++)
+    if (outs[i] == BATCH_GLOBAL)
+      jl_set_global(jl_main_module, names[i], jl_get_nth_field(roots[3], i));
+  JL_GC_POP();
+  return rc;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Mapping over lists
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Convert a list to a vector, typed if the list is homogeneous. Unlike
+   pl_to_jl, nested lists stay elements instead of becoming dimensions */
+static int list_to_vector(term_t list, int len, jl_value_t **ret) {
+  int has_missing;
+  list_elt_t kind = list_elt_kind(list, &has_missing);
+  if (kind != LIST_ELT_NONE && kind != LIST_ELT_ANY)
+    return list_to_typed_jl(list, len, kind, has_missing, ret);
+  jl_array_t *arr = NULL;
+  JL_GC_PUSH1(&arr);
+  arr = jl_alloc_array_1d(jl_apply_array_type((jl_value_t*)jl_any_type, 1), len);
+  *ret = (jl_value_t *) arr;
+  int rc = list_to_jl(list, &arr, FALSE);
+  JL_GC_POP();
+  if (!rc)
+    *ret = NULL;
+  return rc;
+}
+
+/* Out = map_func(F, [chunk,] Lists...), the lists are converted once and the
+   result is unified in bulk. "chunk" is -1 for map and Jurassic.tmap */
+static int map_lists(term_t func_pl, term_t lists, term_t out,
+                     jl_function_t *map_func, int64_t chunk) {
+  int nlists = list_length(lists);
+  if (nlists < 0)
+    return JURASSIC_FAIL;
+  if (nlists == 0)
+    return PL_domain_error("non_empty_list", lists);
+  int first = chunk < 0 ? 1 : 2; /* index of the first vector */
+  int nargs = first + nlists;
+  jl_value_t **args;
+  /* args[0]: function, [args[1]: chunk size,] vectors, args[nargs]: result */
+  JL_GC_PUSHARGS(args, nargs + 1);
+  if (!pl_to_jl(func_pl, &args[0], FALSE) || args[0] == NULL) {
+    JL_GC_POP();
+    return JURASSIC_FAIL;
+  }
+  if (chunk >= 0)
+    args[1] = jl_box_int64(chunk);
+  term_t head = PL_new_term_ref();
+  term_t tail = PL_copy_term_ref(lists);
+  int len = -1;
+  for (int i = first; PL_get_list(tail, head, tail); i++) {
+    int l = list_length(head);
+    /* like maplist/N, lists of different lengths fail */
+    if (l < 0 || (len >= 0 && l != len)) {
+      JL_GC_POP();
+      return JURASSIC_FAIL;
+    }
+    len = l;
+    if (len > 0 && !list_to_vector(head, len, &args[i])) {
+      JL_GC_POP();
+      return JURASSIC_FAIL;
+    }
+  }
+  if (len == 0) {
+    JL_GC_POP();
+    return map_func == jl_pforeach_func ? PL_unify_atom(out, ATOM_nothing) : PL_unify_nil(out);
+  }
+#ifdef JURASSIC_DEBUG
+  printf("[DEBUG] Map over %d list(s) of length %d, chunk = %ld.\n", nlists, len, (long) chunk);
+#endif
+  int outer;
+  STAT_ENTER(STAGE_EVAL, "map", len, outer);
+  args[nargs] = jl_call(map_func, args, nargs);
+  STAT_LEAVE(outer);
+  if (args[nargs] == NULL) {
+    if (jl_exception_occurred())
+      jl_throw_exception();
+    JL_GC_POP();
+    return JURASSIC_FAIL;
+  }
+  int rc = jl_unify_pl(args[nargs], &out, 0);
+  JL_GC_POP();
+  return rc;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Lazy iteration
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Foreign context of jl_member/2, the iterable and the last result of
+   iterate(), i.e. the (item, state) tuple, are GC roots until the
+   iteration ends or is cut */
+typedef struct jl_iter {
+  jl_handle_t iterable;
+  jl_handle_t next;
+} jl_iter_t;
+
+static void free_jl_iter(jl_iter_t *it) {
+  unlink_jl_handle(&it->next);
+  unlink_jl_handle(&it->iterable);
+  free(it);
+}
+
+/* Call iterate(), "state" is NULL for the first item. The result is
+   nothing at the end, NULL on exceptions */
+static jl_value_t *iterate_next(jl_value_t *iterable, jl_value_t *state) {
+  jl_value_t *next = state == NULL
+    ? jl_call1(jl_iterate_func, iterable)
+    : jl_call2(jl_iterate_func, iterable, state);
+  if (next == NULL && jl_exception_occurred())
+    jl_throw_exception();
+  return next;
+}
+
+/* Unify X with the items from it->next on, return TRUE at the first item
+   that unifies, FALSE when the iterable is exhausted */
+static int iterate_unify(jl_iter_t *it, term_t x) {
+  jl_value_t *item = NULL;
+  JL_GC_PUSH1(&item);
+  while (it->next.val != jl_nothing) {
+    item = jl_fieldref(it->next.val, 0);
+    fid_t fid = PL_open_foreign_frame();
+    if (jl_unify_pl(item, &x, 0)) {
+      PL_close_foreign_frame(fid);
+      JL_GC_POP();
+      return TRUE;
+    }
+    PL_discard_foreign_frame(fid);
+    jl_value_t *next = iterate_next(it->iterable.val, jl_fieldref(it->next.val, 1));
+    if (next == NULL)
+      break;
+    it->next.val = next;
+  }
+  JL_GC_POP();
+  return FALSE;
+}
+
+/* Nondeterministically unify X with the items of a Julia iterable, one
+   iterate() call per solution */
+static foreign_t iterate_member(term_t x, term_t iterable_pl, control_t handle) {
+  jl_iter_t *it;
+  jl_value_t *iterable = NULL;
+  jl_value_t *next = NULL;
+  switch (PL_foreign_control(handle)) {
+  case PL_FIRST_CALL:
+    JL_GC_PUSH2(&iterable, &next);
+    if ((!get_jl_handle(iterable_pl, &iterable)
+         && !pl_to_jl(iterable_pl, &iterable, FALSE))
+        || iterable == NULL
+        || (next = iterate_next(iterable, NULL)) == NULL
+        || next == jl_nothing) {
+      JL_GC_POP();
+      PL_fail;
+    }
+    it = malloc(sizeof(jl_iter_t));
+    if (it == NULL) {
+      JL_GC_POP();
+      return PL_resource_error("memory");
+    }
+    it->iterable.val = iterable;
+    it->next.val = next;
+    link_jl_handle(&it->iterable);
+    link_jl_handle(&it->next);
+    JL_GC_POP();
+    break;
+  case PL_REDO:
+    it = PL_foreign_context_address(handle);
+    next = iterate_next(it->iterable.val, jl_fieldref(it->next.val, 1));
+    if (next == NULL) {
+      free_jl_iter(it);
+      PL_fail;
+    }
+    it->next.val = next;
+    break;
+  case PL_PRUNED:
+    it = PL_foreign_context_address(handle);
+    free_jl_iter(it);
+    PL_succeed;
+  default:
+    PL_fail;
+  }
+  if (!iterate_unify(it, x)) {
+    free_jl_iter(it);
+    PL_fail;
+  }
+  PL_retry_address(it);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Dynamic functions
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Prolog atoms to Julia values */
+int atom_to_jl(atom_t atom, jl_value_t **ret, int flag_sym) {
+  const char *a = PL_atom_chars(atom);
+  if (a == NULL) {
+#ifdef JURASSIC_DEBUG
+    printf("Reading string from atom failed!\n");
+#endif
+    *ret = NULL;
+    return JURASSIC_FAIL;
+  }
+  JL_TRY {
+    /* if the atom is julia keywords*/
+    if (atom == ATOM_true) {
+#ifdef JURASSIC_DEBUG
+      printf("boolean: true.\n");
+#endif
+      *ret = jl_true;
+    } else if (atom == ATOM_false) {
+#ifdef JURASSIC_DEBUG
+      printf("boolean: false.\n");
+#endif
+      *ret = jl_false;
+    } else if (atom == ATOM_nothing) {
+#ifdef JURASSIC_DEBUG
+      printf("Nothing.\n");
+      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
+      jl_printf(jl_stdout_stream(), "\n");
+#endif
+      *ret = jl_nothing;
+    } else if (atom == ATOM_missing) {
+#ifdef JURASSIC_DEBUG
+      printf("Missing.\n");
+      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
+      jl_printf(jl_stdout_stream(), "\n");
+#endif
+      *ret = jl_missing_value;
+    }  else if (atom == ATOM_nan) {
+#ifdef JURASSIC_DEBUG
+      printf("NaN.\n");
+      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
+      jl_printf(jl_stdout_stream(), "\n");
+#endif
+      *ret = jl_box_float64(D_PNAN);
+    } else if (atom == ATOM_inf) {
+#ifdef JURASSIC_DEBUG
+      printf("Inf.\n");
+      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
+      jl_printf(jl_stdout_stream(), "\n");
+#endif
+      *ret = jl_box_float64(D_PINF);
+    } else if (atom == ATOM_ninf) {
+#ifdef JURASSIC_DEBUG
+      printf("negative Inf.\n");
+      jl_static_show(jl_stdout_stream(), jl_get_global(jl_main_module, jl_symbol_lookup(a)));
+      jl_printf(jl_stdout_stream(), "\n");
+#endif
+      *ret = jl_box_float64(D_NINF);
+    } else if ((!flag_sym || strchr(a, '.') != NULL)
+               && (*ret = atom_bound_value(atom)) != NULL) {
+      /* get the variable assignment (Main.name or Mod.name) from cache */
+#ifdef JURASSIC_DEBUG
+      printf("defined Julia variable.\n");
+      jl_static_show(jl_stdout_stream(), *ret);
+      jl_printf(jl_stdout_stream(), "\n");
+#endif
+    } else if (strchr(a, '.') != NULL){
+      /* Expression A1.A2 */
+#ifdef JURASSIC_DEBUG
+      printf("dot symbol.\n");
+#endif
+      *ret = jl_dot(a);
+      if (!*ret)
+        return JURASSIC_FAIL;
+    } else { /* default as Symbol */
+#ifdef JURASSIC_DEBUG
+      printf("Fallback to Symbol.\n");
+#endif
+      *ret = (jl_value_t *) atom_to_sym(atom);
+    }
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    *ret = NULL;
+    return JURASSIC_FAIL;
+  }
+  return JURASSIC_SUCCESS;
+}
+
+/* convert prolog term to julia expression */
+jl_expr_t *compound_to_jl_expr(term_t expr) {
+#ifdef JURASSIC_DEBUG
+  char *str_expr;
+  if (!PL_get_chars(expr, &str_expr,
+                    CVT_WRITE|CVT_EXCEPTION|BUF_STACK|REP_UTF8))
+    return NULL;
+  printf("[DEBUG] Parse expression: %s\n", str_expr);
+#endif
+  /* Treat everthing as Symbols */
   atom_t functor;
   size_t arity;
   if (PL_is_list(expr)) {
     /* is list */
     size_t len = list_length(expr);
+    /* homogeneous lists are embedded as typed vectors instead of :vect, the
+       literal may be evaluated many times (function bodies, prepared
+       expressions, lambdas), so each evaluation copies it */
+    int has_missing;
+    list_elt_t kind = list_elt_kind(expr, &has_missing);
+    if (kind != LIST_ELT_NONE && kind != LIST_ELT_ANY) {
+      jl_value_t *arr = NULL;
+      jl_expr_t *ex = NULL;
+      JL_GC_PUSH2(&arr, &ex);
+      if (!list_to_typed_jl(expr, len, kind, has_missing, &arr)) {
+        JL_GC_POP();
+        return NULL;
+      }
+      ex = jl_exprn(jl_symbol("call"), 2);
+      jl_exprargset(ex, 0, jl_copy_func);
+      jl_exprargset(ex, 1, arr);
+      JL_GC_POP();
+      return ex;
+    }
 #ifdef JURASSIC_DEBUG
     printf("        Functor: vect/%lu.\n", len);
 #endif
@@ -589,8 +2921,13 @@ jl_expr_t *compound_to_jl_expr(term_t expr) {
     return ex;
   } else if (!PL_is_compound(expr)) {
     jl_value_t *ret;
+    PL_blob_t *blob_type;
     if (!pl_to_jl(expr, &ret, TRUE))
       return NULL;
+    else if (PL_is_blob(expr, &blob_type) && blob_type == &jl_handle_blob
+             && (jl_is_symbol(ret) || jl_is_expr(ret) || jl_is_quotenode(ret)))
+      /* handles are values, their symbols or Exprs are not evaluated */
+      return (jl_expr_t *) jl_new_struct(jl_quotenode_type, ret);
     else
       return (jl_expr_t *) ret;
   } else if (!PL_get_compound_name_arity_sz(expr, &functor, &arity)) {
@@ -771,6 +3108,37 @@ jl_expr_t *compound_to_jl_expr(term_t expr) {
 #endif
     JL_GC_POP();
     return ex;
+  } else if (PL_is_functor(expr, FUNCTOR_handle1) && arity == 1) {
+    /* handle(Expr) inside an expression is just Expr */
+    term_t arg = PL_new_term_ref();
+    if (!PL_get_arg(1, expr, arg)) {
+      printf("[ERR] Cannot access handle argument!\n");
+      return NULL;
+    }
+    return compound_to_jl_expr(arg);
+  } else if (PL_is_functor(expr, FUNCTOR_array1) && arity == 1) {
+    /* array(NestedList), convert the list to Array{T,N} as a literal */
+    term_t list = PL_new_term_ref();
+    if (!PL_get_arg(1, expr, list)) {
+      printf("[ERR] Cannot access array argument!\n");
+      return NULL;
+    }
+#ifdef JURASSIC_DEBUG
+    printf("        Functor: array/1.\n");
+#endif
+    jl_value_t *arr = NULL;
+    jl_expr_t *ex = NULL;
+    JL_GC_PUSH2(&arr, &ex);
+    if (!pl_to_jl(list, &arr, FALSE) || arr == NULL) {
+      JL_GC_POP();
+      return NULL;
+    }
+    /* copied on every evaluation like list literals */
+    ex = jl_exprn(jl_symbol("call"), 2);
+    jl_exprargset(ex, 0, jl_copy_func);
+    jl_exprargset(ex, 1, arr);
+    JL_GC_POP();
+    return ex;
   } else if (strcmp(fname, "[]") == 0) {
     /* reference in array */
     /* term like a[i,j] =.. [[], [i,j], a]. use :ref function */
@@ -1059,24 +3427,32 @@ jl_expr_t *jl_function(term_t fname_pl, term_t fargs_pl, term_t fexprs_pl) {
 
 int jl_set_args(jl_expr_t **ex, term_t expr, size_t arity, size_t start_jl, size_t start_pl) {
   term_t arg_term = PL_new_term_ref();
+  fid_t fid = PL_open_foreign_frame();
   for (size_t i = 0; i < arity; i++) { // Prolog argument index starts from 1
 #ifdef JURASSIC_DEBUG
     printf("----    Argument %lu: ", i + start_jl);
 #endif
     if (!PL_get_arg(i + start_pl, expr, arg_term)) {
       printf("[ERR] Get term argument %lu failed!\n", i + start_pl);
+      PL_close_foreign_frame(fid);
       return JURASSIC_FAIL;
     }
 #ifdef JURASSIC_DEBUG
     char *str_arg;
     if (!PL_get_chars(arg_term, &str_arg,
-                      CVT_WRITE|CVT_EXCEPTION|BUF_STACK|REP_UTF8))
+                      CVT_WRITE|CVT_EXCEPTION|BUF_STACK|REP_UTF8)) {
+      PL_close_foreign_frame(fid);
       return JURASSIC_FAIL;
+    }
     printf("%s.\n", str_arg);
 #endif
-    if (!jl_set_arg(ex, i + start_jl, arg_term))
+    if (!jl_set_arg(ex, i + start_jl, arg_term)) {
+      PL_close_foreign_frame(fid);
       return JURASSIC_FAIL;
+    }
+    fid = frame_chunk_next(fid, i, FALSE);
   }
+  PL_discard_foreign_frame(fid);
   return JURASSIC_SUCCESS;
 }
 
@@ -1087,20 +3463,20 @@ int list_to_jl(term_t list, jl_array_t **ret, int flag_sym) {
   term_t term = PL_copy_term_ref(list);
 
   size_t i = 0;
+  fid_t fid = PL_open_foreign_frame();
   while (PL_get_list(term, head, term)) {
     if (!pl_to_jl(head, &arr_vals[i], flag_sym)) {
+      PL_close_foreign_frame(fid);
       *ret = NULL;
       return JURASSIC_FAIL;
     }
     jl_gc_wb(*ret, arr_vals[i]); // for safety
+    fid = frame_chunk_next(fid, i, FALSE);
     i++;
   }
+  PL_discard_foreign_frame(fid);
   if (jl_exception_occurred()) {
-    // none of these allocate, so a gc-root (JL_GC_PUSH) is not necessary
-    jl_call2(jl_get_function(jl_base_module, "showerror"),
-             jl_stderr_obj(),
-             jl_exception_occurred());
-    jl_printf(jl_stderr_stream(), "\n");
+    jl_throw_exception();
     return JURASSIC_FAIL;
   }
   return JURASSIC_SUCCESS;
@@ -1120,6 +3496,7 @@ int pl_to_jl(term_t term, jl_value_t **ret, int flag_sym) {
     printf("        Unbound Variable!\n");
 #endif
   *ret = NULL;
+  STAT_ADD(STAT_TERMS, 1);
   switch (PL_term_type(term)) {
   case PL_ATOM: {
 #ifdef JURASSIC_DEBUG
@@ -1157,6 +3534,7 @@ int pl_to_jl(term_t term, jl_value_t **ret, int flag_sym) {
       printf("%s\n", str);
 #endif
       *ret = jl_cstr_to_string(str);
+      STAT_ADD(STAT_ALLOCATED, 1);
     }
     break;
   }
@@ -1165,18 +3543,32 @@ int pl_to_jl(term_t term, jl_value_t **ret, int flag_sym) {
     printf("        Integer: ");
 #endif
     int64_t num_int;
-    /* integer, to int64 */
-    if (!PL_get_int64(term, &num_int)) {
-      *ret = NULL;
+    /* integer, to int64, or BigInt by copying the GMP limbs */
+    if (PL_get_int64(term, &num_int)) {
 #ifdef JURASSIC_DEBUG
-      printf("FAILED!\n");
+      printf("%ld\n", num_int);
 #endif
-      return JURASSIC_FAIL;
+      *ret = jl_box_int64(num_int);
+      STAT_ADD(STAT_ALLOCATED, 1);
     } else {
+      mpz_t mpz;
+      mpz_init(mpz);
+      if (!PL_get_mpz(term, mpz)) {
 #ifdef JURASSIC_DEBUG
-      printf("%ld\n", num_int);
+        printf("FAILED!\n");
 #endif
-      *ret = jl_box_int64(num_int);
+        mpz_clear(mpz);
+        *ret = NULL;
+        return JURASSIC_FAIL;
+      }
+#ifdef JURASSIC_DEBUG
+      gmp_printf("%Zd (BigInt)\n", mpz);
+#endif
+      *ret = mpz_to_jl(mpz);
+      mpz_clear(mpz);
+      if (*ret == NULL)
+        return JURASSIC_FAIL;
+      STAT_ADD(STAT_ALLOCATED, 1);
     }
     break;
   }
@@ -1197,6 +3589,7 @@ int pl_to_jl(term_t term, jl_value_t **ret, int flag_sym) {
       printf("%f\n", num_float);
 #endif
       *ret = jl_box_float64(num_float);
+      STAT_ADD(STAT_ALLOCATED, 1);
     }
     break;
   }
@@ -1214,101 +3607,128 @@ int pl_to_jl(term_t term, jl_value_t **ret, int flag_sym) {
       *ret = NULL;
       mpq_clear(mpq);
       return JURASSIC_FAIL;
-    } else {
-      mpz_t numerator;
-      mpz_t denominator;
-
-      mpz_init(numerator);
-      mpz_init(denominator);
-
-      mpq_get_num(numerator, mpq);
-      mpq_get_den(denominator, mpq);
-
-      if (mpz_fits_slong_p(numerator) && mpz_fits_slong_p(denominator)) {
-        const long num = mpz_get_si(numerator);
-        const long denom = mpz_get_si(denominator);
-
+    }
 #ifdef JURASSIC_DEBUG
-        printf("        %d//%d\n", num, denom);
+    gmp_printf("%Qd\n", mpq);
 #endif
-        /* convert to sexpr(:call, //, nom, denom) */
-        jl_expr_t *expr = jl_exprn(jl_symbol("call"), 3);
-        jl_exprargset(expr, 0, jl_symbol("//"));
-        jl_exprargset(expr, 1, jl_box_int64(num));
-        jl_exprargset(expr, 2, jl_box_int64(denom));
-
-        /* convert to return value */
-        JL_GC_PUSH1(&expr);
-        *ret = jl_toplevel_eval_in(jl_main_module, (jl_value_t *) expr);
-        JL_GC_POP();
-        jl_exception_clear();
-
-        // free
-        mpq_clear(mpq);
-        mpz_clear(numerator);
-        mpz_clear(denominator);
-      } else {
-        // free
-        mpq_clear(mpq);
-        mpz_clear(numerator);
-        mpz_clear(denominator);
-
-        return JURASSIC_FAIL;
-      }
-    }
+    *ret = mpq_to_jl(mpq);
+    mpq_clear(mpq);
+    if (*ret == NULL)
+      return JURASSIC_FAIL;
+    STAT_ADD(STAT_ALLOCATED, 1);
     break;
   }
   case PL_LIST_PAIR: {
     int len = list_length(term);
+    if (len < 0) {
+      *ret = NULL;
+      return JURASSIC_FAIL;
+    }
 #ifdef JURASSIC_DEBUG
     printf("        This is a list, length = %d\n", len);
 #endif
-    jl_array_t *arr = jl_alloc_array_1d(jl_apply_array_type((jl_value_t*)jl_any_type, 1), len);
-
-    if (!list_to_jl(term, &arr, flag_sym)) {
-      *ret = NULL;
+    int outer;
+    STAT_ENTER(STAGE_CONVERT, "list", len, outer);
+    /* rectangular nested lists become Array{T,N} */
+    size_t dims[JURASSIC_MAX_DIMS];
+    int ndims = nested_list_shape(term, dims, JURASSIC_MAX_DIMS);
+    int has_missing = 0;
+    list_elt_t kind = LIST_ELT_NONE;
+    int ok;
+    if (ndims >= 2 && nested_list_scan(term, dims, ndims, 0, &kind, &has_missing)) {
+#ifdef JURASSIC_DEBUG
+      printf("        Nested list, dimensions = %d\n", ndims);
+#endif
+      ok = nested_list_to_jl(term, dims, ndims, kind, has_missing, ret, flag_sym);
+    } else if ((kind = list_elt_kind(term, &has_missing)) != LIST_ELT_NONE
+               && kind != LIST_ELT_ANY) {
+      /* homogeneous lists become concretely typed vectors */
+#ifdef JURASSIC_DEBUG
+      printf("        Homogeneous list, element kind = %d, missing = %d\n", kind, has_missing);
+#endif
+      ok = list_to_typed_jl(term, len, kind, has_missing, ret);
+    } else {
+      jl_array_t *arr = jl_alloc_array_1d(jl_apply_array_type((jl_value_t*)jl_any_type, 1), len);
+      ok = list_to_jl(term, &arr, flag_sym);
+      *ret = ok ? (jl_value_t *) arr : NULL;
+    }
+    STAT_LEAVE(outer);
+    if (!ok)
       return JURASSIC_FAIL;
-    } else
-      *ret = (jl_value_t *) arr;
+    STAT_ADD(STAT_ALLOCATED, 1);
+    STAT_ADD(STAT_ELEMENTS, jl_array_len(*ret));
     break;
   }
   case PL_TERM: {
+    int depth = stat_depth;
+    volatile int call_failed = FALSE;
     JL_TRY {
-      jl_expr_t *expr = compound_to_jl_expr(term);
-      if (expr == NULL) {
-        *ret = NULL;
-        return JURASSIC_FAIL;
-      }
-      JL_GC_PUSH1(&expr);
+      int outer;
+      /* plain calls skip building and evaluating an Expr */
+      if (is_direct_call(term)) {
+        STAT_ENTER(STAGE_EVAL, "call", term_arity(term), outer);
+        int ok = direct_call(term, ret);
+        STAT_LEAVE(outer);
+        if (!ok) {
+          if (jl_exception_occurred())
+            jl_throw_exception();
+          call_failed = TRUE; /* fail after leaving JL_TRY */
+        }
+        jl_exception_clear();
+      } else {
+        STAT_ENTER(STAGE_CONVERT, "compound", term_arity(term), outer);
+        jl_expr_t *expr = compound_to_jl_expr(term);
+        STAT_LEAVE(outer);
+        if (expr == NULL)
+          call_failed = TRUE;
+        else {
+          JL_GC_PUSH1(&expr);
 #ifdef JURASSIC_DEBUG
-      jl_printf(jl_stdout_stream(), "[DEBUG] Parsed expression:\n");
-      jl_static_show(jl_stdout_stream(), (jl_value_t *)expr);
-      jl_printf(jl_stdout_stream(), "\n");
+          jl_printf(jl_stdout_stream(), "[DEBUG] Parsed expression:\n");
+          jl_static_show(jl_stdout_stream(), (jl_value_t *)expr);
+          jl_printf(jl_stdout_stream(), "\n");
 #endif
-      if (jl_is_quotenode(expr))
-        *ret = (jl_value_t *) expr;
-      else
-        *ret = jl_toplevel_eval_in(jl_main_module, (jl_value_t *) expr);
-      JL_GC_POP();
-      jl_exception_clear();
+          if (jl_is_quotenode(expr))
+            *ret = (jl_value_t *) expr;
+          else {
+            STAT_ENTER(STAGE_EVAL, "expr", 0, outer);
+            *ret = jl_toplevel_eval_in(jl_main_module, (jl_value_t *) expr);
+            STAT_LEAVE(outer);
+          }
+          JL_GC_POP();
+        }
+        jl_exception_clear();
+      }
     } JL_CATCH {
       jl_task_t *ct = jl_current_task;
       jl_current_task->ptls->previous_exception = jl_current_exception();
+      STAT_UNWIND(depth);
       jl_throw_exception();
       *ret = NULL;
       return JURASSIC_FAIL;
     }
+    if (call_failed) {
+      *ret = NULL;
+      return JURASSIC_FAIL;
+    }
+    break;
+  }
+  case PL_BLOB: {
+#ifdef JURASSIC_DEBUG
+    printf("        Julia object handle.\n");
+#endif
+    /* Julia object handle, no conversion */
+    if (!get_jl_handle(term, ret)) {
+      *ret = NULL;
+      return JURASSIC_FAIL;
+    }
     break;
   }
   default:
     return JURASSIC_FAIL;
   }
   if (jl_exception_occurred()) {
-    // none of these allocate, so a gc-root (JL_GC_PUSH) is not necessary
-    jl_call2(jl_get_function(jl_base_module, "showerror"),
-             jl_stderr_obj(),
-             jl_exception_occurred());
-    jl_printf(jl_stderr_stream(), "\n");
+    jl_throw_exception();
     return JURASSIC_FAIL;
   }
   return JURASSIC_SUCCESS;
@@ -1386,258 +3806,514 @@ jl_sym_t * compound_to_sym(term_t term) {
   }
 }
 
-/* Unify julia term with prolog term */
-int jl_unify_pl(jl_value_t *val, term_t *ret, int flag_sym) {
-  jl_sym_t *val_type_name_sym = ((jl_datatype_t*)(jl_typeof(val)))->name->name;
-#ifdef JURASSIC_DEBUG
-  printf("[Debug] Julia value:\n");
-  jl_static_show(jl_stdout_stream(), val);
-  jl_printf(jl_stdout_stream(), "\n");
-  printf("[Debug] Julia type:\n");
-  jl_static_show(jl_stdout_stream(), jl_typeof(val));
-  jl_printf(jl_stdout_stream(), "/");
-  jl_static_show(jl_stdout_stream(), (jl_value_t *) val_type_name_sym);
-  jl_printf(jl_stdout_stream(), "\n");
-#endif
-  term_t tmp_term = PL_copy_term_ref(*ret);
-  if (jl_is_nothing(val)) {
-#ifdef JURASSIC_DEBUG
-    printf("        Nothing.\n");
-#endif
-    return PL_unify_atom(tmp_term, ATOM_nothing);
-  } else if (val == jl_eval_string("missing")) {
-#ifdef JURASSIC_DEBUG
-    printf("        Missing.\n");
-#endif
-    return PL_unify_atom(tmp_term, ATOM_missing);
-  } else if (jl_is_bool(val)) {
-#ifdef JURASSIC_DEBUG
-    printf("        Bool: ");
-#endif
-    int retval = jl_unbox_bool(val);
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+   Julia to Prolog type dispatch
+   - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Unify a Julia value of a known type with a Prolog term */
+typedef int (*jl_unify_fn)(jl_value_t *val, term_t ret, int flag_sym);
+
+/* Open addressing table keyed by jl_datatype_t* (concrete types) or by
+   jl_typename_t* (parametric families such as Array, Tuple and Rational),
+   filled once by init_unify_table. */
+#define UNIFY_TABLE_SIZE 128 /* power of 2 */
+typedef struct {
+  const void *key;
+  jl_unify_fn fn;
+} unify_entry_t;
+static unify_entry_t unify_table[UNIFY_TABLE_SIZE];
+
+static size_t unify_table_slot(const void *key) {
+  return ((uintptr_t) key >> 4) & (UNIFY_TABLE_SIZE - 1);
+}
+
+static void unify_table_put(const void *key, jl_unify_fn fn) {
+  size_t i = unify_table_slot(key);
+  while (unify_table[i].key != NULL && unify_table[i].key != key)
+    i = (i + 1) & (UNIFY_TABLE_SIZE - 1);
+  unify_table[i].key = key;
+  unify_table[i].fn = fn;
+}
+
+static jl_unify_fn unify_table_get(const void *key) {
+  size_t i = unify_table_slot(key);
+  while (unify_table[i].key != NULL) {
+    if (unify_table[i].key == key)
+      return unify_table[i].fn;
+    i = (i + 1) & (UNIFY_TABLE_SIZE - 1);
+  }
+  return NULL;
+}
+
+/* IEEE half precision to double */
+static double half_to_double(uint16_t h) {
+  int exp = (h >> 10) & 0x1f;
+  int mant = h & 0x3ff;
+  double v;
+  if (exp == 0)
+    v = ldexp(mant, -24);
+  else if (exp == 31)
+    v = mant ? D_PNAN : D_PINF;
+  else
+    v = ldexp(mant + 1024, exp - 25);
+  return (h >> 15) ? -v : v;
+}
+
+/* Read a 128-bit two's complement integer (little-endian limbs) into "z" */
+static void int128_to_mpz(const uint64_t *p, int is_signed, mpz_t z) {
+  uint64_t limbs[2] = {p[0], p[1]};
+  int neg = is_signed && (limbs[1] >> 63);
+  if (neg) {
+    limbs[0] = ~limbs[0] + 1;
+    limbs[1] = ~limbs[1] + (limbs[0] == 0);
+  }
+  mpz_import(z, 2, -1, sizeof(uint64_t), 0, 0, limbs);
+  if (neg)
+    mpz_neg(z, z);
+}
+
+/* Read any Julia bitstype integer into "z" */
+static int jl_int_to_mpz(jl_value_t *val, mpz_t z) {
+  if (jl_is_int64(val))
+    mpz_set_si(z, jl_unbox_int64(val));
+  else if (jl_is_int32(val))
+    mpz_set_si(z, jl_unbox_int32(val));
+  else if (jl_is_int16(val))
+    mpz_set_si(z, jl_unbox_int16(val));
+  else if (jl_is_int8(val))
+    mpz_set_si(z, jl_unbox_int8(val));
+  else if (jl_is_uint64(val))
+    mpz_set_ui(z, jl_unbox_uint64(val));
+  else if (jl_is_uint32(val))
+    mpz_set_ui(z, jl_unbox_uint32(val));
+  else if (jl_is_uint16(val))
+    mpz_set_ui(z, jl_unbox_uint16(val));
+  else if (jl_is_uint8(val))
+    mpz_set_ui(z, jl_unbox_uint8(val));
+  else if (jl_typeis(val, jl_bigint_dtype))
+    jl_bigint_to_mpz(val, z);
+  else if (jl_typeis(val, jl_int128_dtype))
+    int128_to_mpz((uint64_t *) jl_data_ptr(val), 1, z);
+  else if (jl_typeis(val, jl_uint128_dtype))
+    int128_to_mpz((uint64_t *) jl_data_ptr(val), 0, z);
+  else
+    return JURASSIC_FAIL;
+  return JURASSIC_SUCCESS;
+}
+
+/* Unify a float, infinities and NaN become atoms */
+static int unify_float_or_atom(term_t ret, double f) {
+  if (f == D_PINF)
+    return PL_unify_atom(ret, ATOM_inf);
+  else if (f == D_NINF)
+    return PL_unify_atom(ret, ATOM_ninf);
+  else if (isnan(f))
+    return PL_unify_atom(ret, ATOM_nan);
+  return PL_unify_float(ret, f);
+}
+
+static int unify_nothing(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_atom(ret, ATOM_nothing);
+}
+
+static int unify_missing(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_atom(ret, ATOM_missing);
+}
+
+static int unify_bool(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_bool(ret, jl_unbox_bool(val));
+}
+
+static int unify_int8(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_int64(ret, jl_unbox_int8(val));
+}
+
+static int unify_int16(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_int64(ret, jl_unbox_int16(val));
+}
+
+static int unify_int32(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_int64(ret, jl_unbox_int32(val));
+}
+
+static int unify_int64(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_int64(ret, jl_unbox_int64(val));
+}
+
+static int unify_uint8(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_uint64(ret, jl_unbox_uint8(val));
+}
+
+static int unify_uint16(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_uint64(ret, jl_unbox_uint16(val));
+}
+
+static int unify_uint32(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_uint64(ret, jl_unbox_uint32(val));
+}
+
+static int unify_uint64(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_uint64(ret, jl_unbox_uint64(val));
+}
+
+/* Int128 and UInt128, through GMP when out of the int64 range */
+static int unify_int128(jl_value_t *val, term_t ret, int flag_sym) {
+  const uint64_t *p = (const uint64_t *) jl_data_ptr(val);
+  int is_signed = jl_typeis(val, jl_int128_dtype);
+  if (is_signed && p[1] == (uint64_t) ((int64_t) p[0] >> 63))
+    return PL_unify_int64(ret, (int64_t) p[0]);
+  else if (!is_signed && p[1] == 0)
+    return PL_unify_uint64(ret, p[0]);
+  mpz_t z;
+  mpz_init(z);
+  int128_to_mpz(p, is_signed, z);
+  int rc = PL_unify_mpz(ret, z);
+  mpz_clear(z);
+  return rc;
+}
+
+static int unify_bigint(jl_value_t *val, term_t ret, int flag_sym) {
+  __mpz_struct *jz = (__mpz_struct *) jl_data_ptr(val);
+  mpz_t ro;
+  mpz_roinit_n(ro, jz->_mp_d, jz->_mp_size);
+  return PL_unify_mpz(ret, ro);
+}
+
+static int unify_float16(jl_value_t *val, term_t ret, int flag_sym) {
+  return unify_float_or_atom(ret, half_to_double(*(uint16_t *) jl_data_ptr(val)));
+}
+
+static int unify_float32(jl_value_t *val, term_t ret, int flag_sym) {
+  return unify_float_or_atom(ret, jl_unbox_float32(val));
+}
+
+static int unify_float64(jl_value_t *val, term_t ret, int flag_sym) {
+  return unify_float_or_atom(ret, jl_unbox_float64(val));
+}
+
+/* Char is stored as its UTF-8 bytes, left aligned in 32 bits; it is unified
+   with a single character atom */
+static int unify_char(jl_value_t *val, term_t ret, int flag_sym) {
+  uint32_t u = *(uint32_t *) jl_data_ptr(val);
+  char buf[4];
+  size_t len = 0;
+  for (int shift = 24; shift >= 0 && (len == 0 || ((u >> shift) & 0xff)); shift -= 8)
+    buf[len++] = (u >> shift) & 0xff;
+  return PL_unify_chars(ret, PL_ATOM|REP_UTF8, len, buf);
+}
+
+static int unify_string(jl_value_t *val, term_t ret, int flag_sym) {
+  return PL_unify_chars(ret, PL_STRING|REP_UTF8, jl_string_len(val), jl_string_data(val));
+}
+
+static int unify_quotenode(jl_value_t *val, term_t ret, int flag_sym) {
+  jl_value_t *quotedval = jl_quotenode_value(val);
 #ifdef JURASSIC_DEBUG
-    printf("%d.\n", retval);
+  printf("        QuoteNode of:\n");
+  jl_static_show(jl_stdout_stream(), quotedval);
+  printf("\n");
 #endif
-    return PL_unify_bool(tmp_term, retval);
-  } else if (jl_is_int8(val)) {
+  term_t qval = PL_new_term_ref();
+  return jl_unify_pl(quotedval, &qval, 1)
+    && PL_unify_functor(ret, FUNCTOR_quotenode1)
+    && PL_unify_arg(1, ret, qval);
+}
+
+/* Rational{T} of any integer T */
+static int unify_rational(jl_value_t *val, term_t ret, int flag_sym) {
 #ifdef JURASSIC_DEBUG
-    printf("        Int8: ");
-#endif
-    int8_t retval = jl_unbox_int8(val);
-    #ifdef JURASSIC_DEBUG
-    printf("%ld.\n", retval);
+  printf("        Rational: ");
+  jl_static_show(jl_stdout_stream(), jl_get_nth_field(val, 0));
+  jl_printf(jl_stdout_stream(), "//");
+  jl_static_show(jl_stdout_stream(), jl_get_nth_field(val, 1));
+  jl_printf(jl_stdout_stream(), "\n");
 #endif
-    return PL_unify_integer(tmp_term, retval);
-  } else if (jl_is_int16(val)) {
+  jl_value_t *num_val = NULL;
+  jl_value_t *den_val = NULL;
+  JL_GC_PUSH2(&num_val, &den_val);
+  num_val = jl_get_nth_field(val, 0);
+  den_val = jl_get_nth_field(val, 1);
+
+  mpq_t retval;
+  mpq_init(retval);
+  int rc = jl_int_to_mpz(num_val, mpq_numref(retval))
+    && jl_int_to_mpz(den_val, mpq_denref(retval))
+    && PL_unify_mpq(ret, retval);
+  mpq_clear(retval);
+  JL_GC_POP();
+  return rc;
+}
+
+static int unify_symbol(jl_value_t *val, term_t ret, int flag_sym) {
+  const char *retval = jl_symbol_name((jl_sym_t *)val);
 #ifdef JURASSIC_DEBUG
-    printf("        Int16: ");
+  printf("        Symbol (Atom): %s.\n", retval);
 #endif
-    int16_t retval = jl_unbox_int16(val);
-    #ifdef JURASSIC_DEBUG
-    printf("%ld.\n", retval);
-#endif
-    return PL_unify_integer(tmp_term, retval);
-  } else if (jl_is_int32(val)) {
+  jl_value_t *var_val;
+  if (strchr(retval, '.') != NULL) {
+    return jl_unify_pl(jl_dot(retval), &ret, flag_sym);
+  } else if (!flag_sym && !jl_is_operator((char *)retval)
+             && (var_val = jl_get_global(jl_main_module, (jl_sym_t *) val)) != NULL) {
 #ifdef JURASSIC_DEBUG
-    printf("        Int32: ");
-#endif
-    int32_t retval = jl_unbox_int32(val);
-    #ifdef JURASSIC_DEBUG
-    printf("%ld.\n", retval);
+    printf("--- is defined.\n");
 #endif
-    return PL_unify_integer(tmp_term, retval);
-  } else if (jl_is_int64(val)) {
+    return jl_unify_pl(var_val, &ret, flag_sym);
+  } else {
+    /* unify with :/1 */
+    term_t symname = PL_new_term_ref();
+    return put_sym_atom(symname, (jl_sym_t *) val)
+      && PL_unify_functor(ret, FUNCTOR_quote1)
+      && PL_unify_arg(1, ret, symname);
+  }
+}
+
+static int unify_array(jl_value_t *val, term_t ret, int flag_sym) {
+  if (jl_array_ndims(val) == 1) {
 #ifdef JURASSIC_DEBUG
-    printf("        Int64: ");
+    printf("[DEBUG] 1D Array:\n");
 #endif
-    int64_t retval = jl_unbox_int64(val);
-    #ifdef JURASSIC_DEBUG
-    printf("%ld.\n", retval);
-#endif
-    return PL_unify_int64(tmp_term, retval);
-  } else if (jl_is_uint8(val) || jl_is_uint16(val) || jl_is_uint32(val)
-             || jl_is_uint64(val)) {
+    /* Construct a list */
+    size_t len = jl_array_len(val);
+    if (len == 0) {
 #ifdef JURASSIC_DEBUG
-    printf("        Unsigned Integer: ");
-#endif
-    uint64_t retval = jl_unbox_uint64(val);
-    #ifdef JURASSIC_DEBUG
-    printf("%ud.\n", retval);
+      printf("        Empty Array: []\n");
 #endif
-    return PL_unify_uint64(tmp_term, retval);
-  } else if (jl_typeis(val, jl_float16_type) ||
-             jl_typeis(val, jl_float32_type) ||
-             jl_typeis(val, jl_float64_type)) {
+      return PL_unify_nil(ret);
+    } else if (is_bits_list_array((jl_array_t *) val)) {
 #ifdef JURASSIC_DEBUG
-    printf("        Float: ");
+      printf("        Bitstype Array, length = %lu\n", len);
 #endif
-    double retval;
-    if (jl_typeis(val, jl_float64_type)) {
-      retval = jl_unbox_float64(val);
+      return bits_array_unify_list((jl_array_t *) val, ret);
     } else {
-      retval = jl_unbox_float32(val);
-    }
-#ifdef JURASSIC_DEBUG
-    printf("%f.\n", retval);
-#endif
-    if (retval == D_PINF) {
-#ifdef JURASSIC_DEBUG
-      printf("        Inf.\n");
-#endif
-      return PL_unify_atom(tmp_term, ATOM_inf);
-    } else if (retval == D_NINF) {
-#ifdef JURASSIC_DEBUG
-      printf("        -Inf.\n");
-#endif
-      return PL_unify_atom(tmp_term, ATOM_ninf);
-    } else if (isnan(retval)) {
+      term_t head = PL_new_term_ref();
+      term_t tmp_term = PL_copy_term_ref(ret);
+      fid_t fid = PL_open_foreign_frame();
+      for (size_t i = 0; i < len; i++) {
 #ifdef JURASSIC_DEBUG
-      printf("        NaN.\n");
+        printf("---- #%lu:\n", i);
 #endif
-      return PL_unify_atom(tmp_term, ATOM_nan);
-    } else
-      return PL_unify_float(tmp_term, retval);
-  } else if (jl_is_string(val)) {
-#ifdef JURASSIC_DEBUG
-    printf("        String: ");
-#endif
-    const char *retval = jl_string_ptr(val);
+        if (!PL_unify_list(tmp_term, head, tmp_term) ||
+            !jl_unify_pl(jl_arrayref((jl_array_t *)val, i), &head, flag_sym)) {
+          PL_close_foreign_frame(fid);
+          return JURASSIC_FAIL;
+        }
+        fid = frame_chunk_next(fid, i, TRUE);
+      }
+      PL_close_foreign_frame(fid);
+      return PL_unify_nil(tmp_term);
+    }
+  } else {
 #ifdef JURASSIC_DEBUG
-    printf("%s.\n", retval);
+    printf("[DEBUG] %dD Array:\n", jl_array_ndims(val));
 #endif
-    return PL_unify_string_chars(tmp_term, retval);
-  } else if (jl_is_quotenode(val)) {
-    jl_value_t *quotedval = jl_quotenode_value(val);
+    return array_nd_unify_pl((jl_array_t *) val, ret, flag_sym);
+  }
+}
+
+static int unify_tuple(jl_value_t *val, term_t ret, int flag_sym) {
 #ifdef JURASSIC_DEBUG
-    printf("        QuoteNode of:\n");
-    jl_static_show(jl_stdout_stream(), quotedval);
-    printf("\n");
+  printf("[DEBUG] Tuple:\n");
 #endif
-    term_t qval = PL_new_term_ref();
-    return jl_unify_pl(quotedval, &qval, 1)
-      && PL_unify_functor(tmp_term, FUNCTOR_quotenode1)
-      && PL_unify_arg(1, tmp_term, qval);
-  } else if (strcmp(jl_symbol_name(val_type_name_sym), "Rational") == 0) {
-        // Rational number
+  term_t tmp_term = PL_copy_term_ref(ret);
+  return PL_unify_functor(tmp_term, FUNCTOR_tuple1) && jl_tuple_unify_all(&tmp_term, val);
+}
+
+static int unify_expr(jl_value_t *val, term_t ret, int flag_sym) {
 #ifdef JURASSIC_DEBUG
-    printf("        Rational: ");
-    jl_static_show(jl_stdout_stream(), jl_get_nth_field(val, 0));
-    jl_printf(jl_stdout_stream(), "//");
-    jl_static_show(jl_stdout_stream(), jl_get_nth_field(val, 1));
-    jl_printf(jl_stdout_stream(), "\n");
+  printf("[DEBUG] Expr:\n");
 #endif
-    mpq_t retval;
-    mpz_t num;
-    mpz_t denom;
-
-    int64_t numerator = jl_unbox_int64(jl_get_nth_field(val, 0));
-    int64_t denominator = jl_unbox_int64(jl_get_nth_field(val, 1));
+  jl_sym_t *head = ((jl_expr_t *)val)->head;
+  jl_array_t *args = ((jl_expr_t *)val)->args;
 
-    mpz_init(num);
-    mpz_init(denom);
+  term_t head_term = PL_new_term_ref();
+  if (!jl_unify_pl((jl_value_t *)head, &head_term, 1))
+    return JURASSIC_FAIL;
 
-    mpz_set_si(num, numerator);
-    mpz_set_si(denom, denominator);
+  term_t args_term = PL_new_term_ref();
+  if (!jl_unify_pl((jl_value_t *)args, &args_term, 1))
+    return JURASSIC_FAIL;
 
-    mpq_init(retval);
+  return PL_unify_functor(ret, FUNCTOR_expr2)
+    && PL_unify_arg(1, ret, head_term)
+    && PL_unify_arg(2, ret, args_term);
+}
 
-    mpq_set_num(retval, num);
-    mpq_set_den(retval, denom);
+/* Look up the GMP backed Julia types, must be called after jl_init() */
+static void init_gmp_types(void) {
+  jl_value_t *rational = jl_get_global(jl_base_module, jl_symbol("Rational"));
+  jl_value_t *gmp = jl_get_global(jl_base_module, jl_symbol("GMP"));
+  jl_value_t *mpz = (gmp && jl_is_module(gmp)) ?
+    jl_get_global((jl_module_t *) gmp, jl_symbol("MPZ")) : NULL;
+  jl_bigint_dtype = (jl_datatype_t *) jl_get_global(jl_base_module, jl_symbol("BigInt"));
+  jl_rational_int64_dtype = (jl_datatype_t *)
+    jl_apply_type1(rational, (jl_value_t *) jl_int64_type);
+  jl_rational_bigint_dtype = (jl_datatype_t *)
+    jl_apply_type1(rational, (jl_value_t *) jl_bigint_dtype);
+  jl_mpz_realloc2_func = (mpz && jl_is_module(mpz)) ?
+    jl_get_function((jl_module_t *) mpz, "realloc2") : NULL;
+}
 
-    int ret = PL_unify_mpq(tmp_term, retval);
+/* Build the dispatch table, must be called after jl_init() */
+static void init_unify_table(void) {
+  jl_value_t *rational = jl_get_global(jl_base_module, jl_symbol("Rational"));
 
-    mpz_clear(num);
-    mpz_clear(denom);
-    mpq_clear(retval);
+  unify_table_put(jl_typeof(jl_nothing), unify_nothing);
+  unify_table_put(jl_missing_type, unify_missing);
+  unify_table_put(jl_bool_type, unify_bool);
+  unify_table_put(jl_int8_type, unify_int8);
+  unify_table_put(jl_int16_type, unify_int16);
+  unify_table_put(jl_int32_type, unify_int32);
+  unify_table_put(jl_int64_type, unify_int64);
+  unify_table_put(jl_int128_dtype, unify_int128);
+  unify_table_put(jl_uint8_type, unify_uint8);
+  unify_table_put(jl_uint16_type, unify_uint16);
+  unify_table_put(jl_uint32_type, unify_uint32);
+  unify_table_put(jl_uint64_type, unify_uint64);
+  unify_table_put(jl_uint128_dtype, unify_int128);
+  unify_table_put(jl_bigint_dtype, unify_bigint);
+  unify_table_put(jl_float16_type, unify_float16);
+  unify_table_put(jl_float32_type, unify_float32);
+  unify_table_put(jl_float64_type, unify_float64);
+  unify_table_put(jl_char_type, unify_char);
+  unify_table_put(jl_string_type, unify_string);
+  unify_table_put(jl_quotenode_type, unify_quotenode);
+  unify_table_put(jl_symbol_type, unify_symbol);
+  unify_table_put(jl_expr_type, unify_expr);
+  /* parametric families by type name */
+  unify_table_put(jl_array_typename, unify_array);
+  unify_table_put(jl_tuple_typename, unify_tuple);
+  if (rational)
+    unify_table_put(((jl_datatype_t *) jl_unwrap_unionall(rational))->name, unify_rational);
+}
 
-    return ret;
-  } else if (jl_is_symbol(val)) {
+/* Unify julia term with prolog term */
+int jl_unify_pl(jl_value_t *val, term_t *ret, int flag_sym) {
+  jl_datatype_t *val_type = (jl_datatype_t *) jl_typeof(val);
 #ifdef JURASSIC_DEBUG
-    printf("        Symbol (Atom): ");
+  printf("[Debug] Julia value:\n");
+  jl_static_show(jl_stdout_stream(), val);
+  jl_printf(jl_stdout_stream(), "\n");
+  printf("[Debug] Julia type:\n");
+  jl_static_show(jl_stdout_stream(), (jl_value_t *) val_type);
+  jl_printf(jl_stdout_stream(), "\n");
 #endif
-    const char *retval = jl_symbol_name((jl_sym_t *)val);
+  jl_unify_fn fn = unify_table_get(val_type);
+  if (fn == NULL)
+    fn = unify_table_get(val_type->name);
+  if (fn == NULL) {
 #ifdef JURASSIC_DEBUG
-    printf("%s.\n", retval);
+    printf("        No conversion for this type.\n");
 #endif
-    if (strchr(retval, '.') != NULL) {
-      return jl_unify_pl(jl_dot(retval), &tmp_term, flag_sym);
-    } else if (jl_is_defined(retval) && !jl_is_operator((char *)retval)
-               && !flag_sym) {
-#ifdef JURASSIC_DEBUG
-      printf("--- is defined.\n");
+    return JURASSIC_FAIL;
+  }
+  STAT_ADD(STAT_UNIFIED, 1);
+  if (jl_is_array(val))
+    STAT_ADD(STAT_ELEMENTS, jl_array_len(val));
+  int outer;
+  STAT_ENTER(STAGE_UNIFY, type_name_chars(val),
+             jl_is_array(val) ? jl_array_len(val) : 1, outer);
+  int rc = fn(val, *ret, flag_sym);
+  STAT_LEAVE(outer);
+  return rc;
+}
+
+/*******************************
+ *          registers          *
+ *******************************/
+#ifndef JULIA_BINDIR
+#define JULIA_BINDIR NULL /* set by c/Makefile */
 #endif
-      jl_value_t *var_val;
-      if (!jl_access_var(retval, &var_val))
-        return JURASSIC_FAIL;
-      return jl_unify_pl(var_val, &tmp_term, flag_sym);
-    } else {
-      /* unify with :/1 */
-      term_t symname = PL_new_term_ref();
-      return PL_put_atom(symname, PL_new_atom(retval))
-        && PL_unify_functor(tmp_term, FUNCTOR_quote1)
-        && PL_unify_arg(1, tmp_term, symname);
+
+/* Load julia/jurassic.jl (next to the lib/ directory of this library) into
+   Main, unless the system image already has the Jurassic module */
+static void init_jurassic_module(void) {
+  jl_sym_t *name = jl_symbol("Jurassic");
+  jl_value_t *mod = jl_get_global(jl_main_module, name);
+  if (mod == NULL) {
+    Dl_info info;
+    char path[BUFFSIZE];
+    const char *dir = ".";
+    char so_path[BUFFSIZE];
+    if (dladdr((void *) install_jurassic, &info) && info.dli_fname != NULL) {
+      strncpy(so_path, info.dli_fname, BUFFSIZE - 1);
+      so_path[BUFFSIZE - 1] = '\0';
+      dir = dirname(so_path);
     }
-  } else if (jl_is_array(val)) {
-    if (jl_array_ndims(val) == 1) {
-#ifdef JURASSIC_DEBUG
-      printf("[DEBUG] 1D Array:\n");
-#endif
-      /* Construct a list */
-      size_t len = jl_array_len(val);
-      if (len == 0) {
-#ifdef JURASSIC_DEBUG
-        printf("        Empty Array: []\n");
-#endif
-        return PL_unify_nil(tmp_term);
-      } else {
-        term_t head = PL_new_term_ref();
-        for (size_t i = 0; i < len; i++) {
-#ifdef JURASSIC_DEBUG
-          printf("---- #%lu:\n", i);
-#endif
-          if (!PL_unify_list(tmp_term, head, tmp_term) ||
-              !jl_unify_pl(jl_arrayref((jl_array_t *)val, i), &head, flag_sym))
-            return JURASSIC_FAIL;
-        }
-        return PL_unify_nil(tmp_term);
-      }
-    } else {
-      // Unify with Multi-dimensional arrays with nested list is implemented with Julia function
-      printf("[ERR] Cannot unify list with matrices and tensors, please enable \"jl_unify_arrays\"!\n");
-      return JURASSIC_FAIL;
+    snprintf(path, BUFFSIZE, "%s/../julia/jurassic.jl", dir);
+    JL_TRY {
+      jl_load(jl_main_module, path);
+      jl_exception_clear();
+    } JL_CATCH {
+      jl_task_t *ct = jl_current_task;
+      jl_current_task->ptls->previous_exception = jl_current_exception();
+      printf("[ERR] Cannot load %s, jl_tmaplist, jl_pmap, jl_pforeach and "
+             "jl_gc_stats are disabled!\n", path);
+      jl_throw_exception();
+      return;
     }
-  } else if (jl_is_tuple(val)) {
-#ifdef JURASSIC_DEBUG
-    printf("[DEBUG] Tuple:\n");
-#endif
-    /* Tuple */
-    return PL_unify_functor(tmp_term, FUNCTOR_tuple1) && jl_tuple_unify_all(&tmp_term, val);
-  } else if (jl_is_expr(val)) {
-    /* Expr */
-#ifdef JURASSIC_DEBUG
-    printf("[DEBUG] Expr:\n");
-#endif
-    jl_sym_t *head = ((jl_expr_t *)val)->head;
-    jl_array_t *args = ((jl_expr_t *)val)->args;
-
-    term_t head_term = PL_new_term_ref();
-    if (!jl_unify_pl((jl_value_t *)head, &head_term, 1))
-      return JURASSIC_FAIL;
+    mod = jl_get_global(jl_main_module, name);
+  }
+  if (mod == NULL || !jl_is_module(mod))
+    return;
+  jl_tmap_func = jl_get_function((jl_module_t *) mod, "tmap");
+  jl_pmap_func = jl_get_function((jl_module_t *) mod, "pmap");
+  jl_pforeach_func = jl_get_function((jl_module_t *) mod, "pforeach");
+  jl_gc_counts_func = jl_get_function((jl_module_t *) mod, "gc_counts");
+  jl_check_globals_func = jl_get_function((jl_module_t *) mod, "check_globals");
+}
 
-    term_t args_term = PL_new_term_ref();
-    if (!jl_unify_pl((jl_value_t *)args, &args_term, 1))
-      return JURASSIC_FAIL;
+/* Read the jl_threads flag before jl_init(), it is a positive integer or
+   `auto` for one thread per CPU. It is passed as JULIA_NUM_THREADS, which
+   jl_init() reads on every Julia version, unlike jl_options.nthreads that
+   needs the per-threadpool counts since Julia 1.9 */
+static void init_jl_threads(void) {
+  int64_t n;
+  atom_t a;
+  char num[32];
+  if (PL_current_prolog_flag(ATOM_jl_threads, PL_INTEGER, &n) && n > 0) {
+    snprintf(num, sizeof(num), "%ld", (long) n);
+    setenv("JULIA_NUM_THREADS", num, 1);
+  } else if (PL_current_prolog_flag(ATOM_jl_threads, PL_ATOM, &a)
+             && strcmp(PL_atom_chars(a), "auto") == 0)
+    setenv("JULIA_NUM_THREADS", "auto", 1);
+}
 
-    return PL_unify_functor(tmp_term, FUNCTOR_expr2)
-      && PL_unify_arg(1, tmp_term, head_term)
-      && PL_unify_arg(2, tmp_term, args_term);
-  }
-  return JURASSIC_FAIL;
+/* Record the compiled method specialisations as precompile statements into
+   the file of the jl_trace_compile flag, like `julia --trace-compile`; Julia
+   opens the file at the first compilation */
+static void init_jl_trace_compile(void) {
+  atom_t file;
+  if (PL_current_prolog_flag(PL_new_atom("jl_trace_compile"), PL_ATOM, &file))
+    jl_options.trace_compile = strdup(PL_atom_chars(file));
 }
 
-/*******************************
- *          registers          *
- *******************************/
+/* thread-aware entry points of the foreign predicates */
+JL_THREADED(jl_eval_str, (term_t jl_expr, term_t pl_ret), (jl_expr, pl_ret))
+JL_THREADED(jl_eval, (term_t jl_expr, term_t pl_ret), (jl_expr, pl_ret))
+JL_THREADED(jl_tuple_unify_str, (term_t pl_tuple, term_t jl_expr_str), (pl_tuple, jl_expr_str))
+JL_THREADED(jl_tuple_unify, (term_t pl_tuple, term_t jl_expr), (pl_tuple, jl_expr))
+JL_THREADED(jl_send_command_str, (term_t jl_expr), (jl_expr))
+JL_THREADED(jl_send_command, (term_t jl_expr), (jl_expr))
+JL_THREADED(jl_isdefined, (term_t jl_expr), (jl_expr))
+JL_THREADED(jl_using, (term_t term), (term))
+JL_THREADED(jl_include, (term_t term), (term))
+JL_THREADED(jl_declare_function, (term_t fname_pl, term_t fargs_pl, term_t fexprs_pl), (fname_pl, fargs_pl, fexprs_pl))
+JL_THREADED(jl_type_name, (term_t jl_expr, term_t type_name_term), (jl_expr, type_name_term))
+JL_THREADED(jl_embed_halt, (void), ())
+JL_THREADED(jl_eval_handle, (term_t jl_expr, term_t handle), (jl_expr, handle))
+JL_THREADED(jl_array_new, (term_t name, term_t type, term_t init, term_t size), (name, type, init, size))
+JL_THREADED(jl_array_get, (term_t array, term_t index, term_t value), (array, index, value))
+JL_THREADED(jl_array_set, (term_t array, term_t index, term_t value), (array, index, value))
+JL_THREADED(jl_array_fill, (term_t array, term_t value), (array, value))
+JL_THREADED(jl_array_slice, (term_t array, term_t offset, term_t limit, term_t list), (array, offset, limit, list))
+JL_THREADED(jl_prepare_function, (term_t body, term_t params, term_t handle), (body, params, handle))
+JL_THREADED(jl_exec, (term_t handle, term_t args, term_t result), (handle, args, result))
+JL_THREADED(jl_batch, (term_t goals, term_t results), (goals, results))
+JL_THREADED(jl_map_lists, (term_t func, term_t lists, term_t out, term_t mode), (func, lists, out, mode))
+JL_THREADED(jl_member, (term_t x, term_t iterable, control_t handle), (x, iterable, handle))
+JL_THREADED(jl_gc_stats, (term_t dict), (dict))
+JL_THREADED(jl_gc, (term_t action), (action))
+JL_THREADED(jl_gc_policy, (term_t options), (options))
+
 install_t install_jurassic(void) {
   ATOM_true = PL_new_atom("true");
   ATOM_false = PL_new_atom("false");
@@ -1646,6 +4322,13 @@ install_t install_jurassic(void) {
   ATOM_nothing = PL_new_atom("nothing");
   ATOM_inf = PL_new_atom("inf");
   ATOM_ninf = PL_new_atom("ninf");
+  ATOM_undef = PL_new_atom("undef");
+  ATOM_jl_error = PL_new_atom("jl_error");
+  ATOM_print = PL_new_atom("print");
+  ATOM_fail = PL_new_atom("fail");
+  ATOM_jl_threads = PL_new_atom("jl_threads");
+  init_stat_atoms();
+  init_gc_stat_atoms();
   FUNCTOR_dot2 = PL_new_functor(ATOM_dot, 2);
   FUNCTOR_quote1 = PL_new_functor(PL_new_atom(":"), 1);
   FUNCTOR_quotenode1 = PL_new_functor(PL_new_atom("$"), 1);
@@ -1661,21 +4344,49 @@ install_t install_jurassic(void) {
   FUNCTOR_dividesequal2 = PL_new_functor(PL_new_atom("/="), 2);
   FUNCTOR_powerequal2 = PL_new_functor(PL_new_atom("^="), 2);
   FUNCTOR_expr2 = PL_new_functor(PL_new_atom("jl_expr"), 2);
+  FUNCTOR_array1 = PL_new_functor(PL_new_atom("array"), 1);
+  FUNCTOR_handle1 = PL_new_functor(PL_new_atom("handle"), 1);
+  FUNCTOR_assign1 = PL_new_functor(PL_new_atom(":="), 1);
+  FUNCTOR_assign2 = PL_new_functor(PL_new_atom(":="), 2);
+  FUNCTOR_chunk1 = PL_new_functor(PL_new_atom("chunk"), 1);
+  FUNCTOR_foreach1 = PL_new_functor(PL_new_atom("foreach"), 1);
+  FUNCTOR_threshold1 = PL_new_functor(PL_new_atom("threshold"), 1);
+  FUNCTOR_prolog_gc1 = PL_new_functor(PL_new_atom("prolog_gc"), 1);
 
   /* Registration */
-  PL_register_foreign("jl_eval_str", 2, jl_eval_str, 0);
-  PL_register_foreign("jl_eval", 2, jl_eval, 0);
-  PL_register_foreign("jl_tuple_unify_str", 2, jl_tuple_unify_str, 0);
-  PL_register_foreign("jl_tuple_unify", 2, jl_tuple_unify, 0);
-  PL_register_foreign("jl_send_command_str", 1, jl_send_command_str, 0);
-  PL_register_foreign("jl_send_command", 1, jl_send_command, 0);
-  PL_register_foreign("jl_isdefined", 1, jl_isdefined, 0);
-  PL_register_foreign("jl_using", 1, jl_using, 0);
-  PL_register_foreign("jl_include", 1, jl_include, 0);
-  PL_register_foreign("jl_declare_function", 3, jl_declare_function, 0);
-  PL_register_foreign("jl_declare_macro_function", 4, jl_declare_function, 0);
-  PL_register_foreign("jl_type_name", 2, jl_type_name, 0);
-  PL_register_foreign("jl_embed_halt", 0, jl_embed_halt, 0);
+  PL_register_foreign("jl_eval_str", 2, jl_eval_str_mt, 0);
+  PL_register_foreign("jl_eval", 2, jl_eval_mt, 0);
+  PL_register_foreign("jl_tuple_unify_str", 2, jl_tuple_unify_str_mt, 0);
+  PL_register_foreign("jl_tuple_unify", 2, jl_tuple_unify_mt, 0);
+  PL_register_foreign("jl_send_command_str", 1, jl_send_command_str_mt, 0);
+  PL_register_foreign("jl_send_command", 1, jl_send_command_mt, 0);
+  PL_register_foreign("jl_isdefined", 1, jl_isdefined_mt, 0);
+  PL_register_foreign("jl_using", 1, jl_using_mt, 0);
+  PL_register_foreign("jl_include", 1, jl_include_mt, 0);
+  PL_register_foreign("jl_declare_function", 3, jl_declare_function_mt, 0);
+  PL_register_foreign("jl_declare_macro_function", 4, jl_declare_function_mt, 0);
+  PL_register_foreign("jl_type_name", 2, jl_type_name_mt, 0);
+  PL_register_foreign("jl_embed_halt", 0, jl_embed_halt_mt, 0);
+  PL_register_foreign("jl_eval_handle", 2, jl_eval_handle_mt, 0);
+  PL_register_foreign("jl_array_new", 4, jl_array_new_mt, 0);
+  PL_register_foreign("jl_array_get", 3, jl_array_get_mt, 0);
+  PL_register_foreign("jl_array_set", 3, jl_array_set_mt, 0);
+  PL_register_foreign("jl_array_fill", 2, jl_array_fill_mt, 0);
+  PL_register_foreign("jl_array_slice", 4, jl_array_slice_mt, 0);
+  PL_register_foreign("jl_prepare_function", 3, jl_prepare_function_mt, 0);
+  PL_register_foreign("jl_exec", 3, jl_exec_mt, 0);
+  PL_register_foreign("jl_batch", 2, jl_batch_mt, 0);
+  PL_register_foreign("jl_map_lists", 4, jl_map_lists_mt, 0);
+  PL_register_foreign("jl_member", 2, jl_member_mt, PL_FA_NONDETERMINISTIC);
+  PL_register_foreign("jl_gc_stats", 1, jl_gc_stats_mt, 0);
+  PL_register_foreign("jl_gc", 1, jl_gc_mt, 0);
+  PL_register_foreign("jl_gc_policy", 1, jl_gc_policy_mt, 0);
+  PL_register_foreign("jl_stats", 1, jl_stats, 0);
+  PL_register_foreign("jl_stats_reset", 0, jl_stats_reset, 0);
+  PL_register_foreign("jl_stats_enable", 1, jl_stats_enable, 0);
+  PL_register_foreign("jl_trace", 1, jl_trace, 0);
+  PL_register_foreign("jl_trace_dump", 1, jl_trace_dump, 0);
+  pthread_key_create(&trace_ring_key, release_trace_ring);
 
   printf("Initialise Embedded Julia ...");
 
@@ -1687,12 +4398,46 @@ install_t install_jurassic(void) {
     exit(1);
   }
 
-  /* initialisation */
-  jl_init();
+  /* number of Julia threads, the flag overrides JULIA_NUM_THREADS */
+  init_jl_threads();
+  /* precompile statements of this session, see jl_precompile_from/2 */
+  init_jl_trace_compile();
 
-  // jl_load(jl_main_module, "julia/arrays.jl");
+  /* initialisation, with the system image of the jl_sysimage flag if any */
+  atom_t sysimage;
+  const char *bindir = getenv("JULIA_BINDIR");
+  if (bindir == NULL)
+    bindir = JULIA_BINDIR;
+  int has_image = PL_current_prolog_flag(PL_new_atom("jl_sysimage"), PL_ATOM, &sysimage);
+  if (has_image && bindir == NULL)
+    printf("[ERR] jl_sysimage needs JULIA_BINDIR, starting with the default image!\n");
+  if (has_image && bindir != NULL) {
+    /* relative image paths would be resolved against the bindir */
+    char *image = realpath(PL_atom_chars(sysimage), NULL);
+    jl_init_with_image(bindir, image != NULL ? image : PL_atom_chars(sysimage));
+    free(image);
+  } else
+    jl_init();
+
+  /* cache julia singletons */
+  jl_missing_value = jl_get_global(jl_base_module, jl_symbol("missing"));
+  jl_missing_type = jl_typeof(jl_missing_value);
+  jl_convert_func = jl_get_function(jl_base_module, "convert");
+  jl_map_func = jl_get_function(jl_base_module, "map");
+  jl_copy_func = jl_get_function(jl_base_module, "copy");
+  jl_iterate_func = jl_get_function(jl_base_module, "iterate");
+  init_jurassic_module();
+  jl_int128_dtype = (jl_datatype_t *) jl_get_global(jl_core_module, jl_symbol("Int128"));
+  jl_uint128_dtype = (jl_datatype_t *) jl_get_global(jl_core_module, jl_symbol("UInt128"));
+  init_gmp_types();
+  init_unify_table();
+  jl_gc_set_cb_root_scanner(jl_handle_root_scanner, 1);
 
   checked_send_command_str("println(\" Done.\")");
+  /* Julia exceptions are reported according to the jl_error flag from now */
+  jl_installed = TRUE;
+  /* back to Prolog, see jl_thread_enter */
+  jl_gc_safe_enter(jl_current_task->ptls);
 }
 
 /* Allow returning value and unifying with Prolog variable */
@@ -1722,6 +4467,211 @@ foreign_t jl_eval(term_t jl_expr, term_t pl_ret) {
   PL_succeed;
 }
 
+/* Evaluate an expression and keep the result as a Julia object handle */
+foreign_t jl_eval_handle(term_t jl_expr, term_t handle) {
+  jl_value_t *ret = NULL;
+  volatile int rc = JURASSIC_FAIL;
+  JL_GC_PUSH1(&ret);
+  JL_TRY {
+    if (pl_to_jl(jl_expr, &ret, TRUE) && ret != NULL) {
+#ifdef JURASSIC_DEBUG
+      printf("[DEBUG] Handle of:\n");
+      jl_static_show(jl_stdout_stream(), ret);
+      jl_printf(jl_stdout_stream(), "\n");
+#endif
+      rc = unify_jl_handle(handle, ret);
+    }
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    rc = JURASSIC_FAIL;
+  }
+  JL_GC_POP();
+  return rc;
+}
+
+/* Native array API: no parsing and no Expr construction. Arrays are given by
+   the name of a Julia global or by a handle. */
+foreign_t jl_array_new(term_t name, term_t type, term_t init, term_t size) {
+  int rc = JURASSIC_FAIL;
+  JL_TRY {
+    rc = array_new(name, type, init, size);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
+foreign_t jl_array_get(term_t array, term_t index, term_t value) {
+  jl_array_t *arr;
+  size_t i;
+  if (!get_jl_array(array, &arr) || !get_array_index(arr, index, &i))
+    PL_fail;
+  int rc = JURASSIC_FAIL;
+  JL_TRY {
+    rc = unify_array_elt(arr, i, value); /* #undef elements throw */
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
+foreign_t jl_array_set(term_t array, term_t index, term_t value) {
+  jl_array_t *arr;
+  size_t i;
+  if (!get_jl_array(array, &arr) || !get_array_index(arr, index, &i))
+    PL_fail;
+  int rc = JURASSIC_FAIL;
+  JL_TRY {
+    rc = set_array_elt(arr, value, i);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
+foreign_t jl_array_fill(term_t array, term_t value) {
+  jl_array_t *arr;
+  if (!get_jl_array(array, &arr))
+    PL_fail;
+  int rc = JURASSIC_FAIL;
+  JL_TRY {
+    rc = array_fill(arr, value);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
+foreign_t jl_array_slice(term_t array, term_t offset, term_t limit, term_t list) {
+  jl_array_t *arr;
+  size_t off, lim;
+  if (!get_jl_array(array, &arr) || !PL_get_size_ex(offset, &off) || !PL_get_size_ex(limit, &lim))
+    PL_fail;
+  int rc = JURASSIC_FAIL;
+  JL_TRY {
+    rc = array_slice(arr, off, lim, list);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
+/* Prepared expressions: the template is compiled once into a function of
+   its parameters, later calls only convert the arguments */
+foreign_t jl_prepare_function(term_t body, term_t params, term_t handle) {
+  int rc = JURASSIC_FAIL;
+  JL_TRY {
+    rc = prepare_function(body, params, handle);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
+foreign_t jl_exec(term_t handle, term_t args, term_t result) {
+  int rc = JURASSIC_FAIL;
+  JL_TRY {
+    rc = exec_function(handle, args, result);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
+foreign_t jl_batch(term_t goals, term_t results) {
+  int rc = JURASSIC_FAIL;
+  JL_TRY {
+    rc = batch_eval(goals, results);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
+/* mode is false (map), true (threads), chunk(N) (jl_pmap) or foreach(N) */
+foreign_t jl_map_lists(term_t func, term_t lists, term_t out, term_t mode) {
+  int use_threads;
+  int64_t chunk = -1;
+  jl_function_t *map_func;
+  const char *map_name;
+  term_t arg = PL_new_term_ref();
+  if (PL_get_bool(mode, &use_threads)) {
+    map_func = use_threads ? jl_tmap_func : jl_map_func;
+    map_name = use_threads ? "Jurassic.tmap" : "Base.map";
+  } else if (PL_is_functor(mode, FUNCTOR_chunk1) || PL_is_functor(mode, FUNCTOR_foreach1)) {
+    int chunked = PL_is_functor(mode, FUNCTOR_chunk1);
+    map_func = chunked ? jl_pmap_func : jl_pforeach_func;
+    map_name = chunked ? "Jurassic.pmap" : "Jurassic.pforeach";
+    if (!PL_get_arg(1, mode, arg) || !PL_get_int64_ex(arg, &chunk))
+      PL_fail;
+    if (chunk < 0)
+      return PL_domain_error("not_less_than_zero", arg);
+  } else
+    return PL_domain_error("map_mode", mode);
+  if (!check_jurassic_function(map_func, map_name))
+    PL_fail;
+  int rc = JURASSIC_FAIL;
+  JL_TRY {
+    rc = map_lists(func, lists, out, map_func, chunk);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
+foreign_t jl_member(term_t x, term_t iterable, control_t handle) {
+  foreign_t rc = FALSE;
+  JL_TRY {
+    rc = iterate_member(x, iterable, handle);
+    jl_exception_clear();
+  } JL_CATCH {
+    jl_task_t *ct = jl_current_task;
+    jl_current_task->ptls->previous_exception = jl_current_exception();
+    jl_throw_exception();
+    PL_fail;
+  }
+  return rc;
+}
+
 /* evaluate a string expression */
 foreign_t jl_eval_str(term_t jl_expr, term_t pl_ret) {
   char *expression;
@@ -1788,12 +4738,8 @@ foreign_t jl_send_command_str(term_t jl_expr) {
 foreign_t jl_send_command(term_t jl_expr) {
   jl_value_t *ret;
   if (!pl_to_jl(jl_expr, &ret, TRUE) || ret == NULL) {
-    if (jl_exception_occurred()) {
-      jl_call2(jl_get_function(jl_base_module, "showerror"),
-               jl_stderr_obj(),
-               jl_exception_occurred());
-      jl_printf(jl_stderr_stream(), "\n");
-    }
+    if (jl_exception_occurred())
+      jl_throw_exception();
     PL_fail;
   }
 #ifdef JURASSIC_DEBUG
@@ -1947,12 +4893,8 @@ foreign_t jl_declare_macro_function(term_t mname_pl, term_t fname_pl, term_t far
 foreign_t jl_type_name(term_t jl_expr, term_t type_name_term) {
   jl_value_t *tmp_val;
   if (!pl_to_jl(jl_expr, &tmp_val, FALSE) || tmp_val == NULL) {
-    if (jl_exception_occurred()) {
-      jl_call2(jl_get_function(jl_base_module, "showerror"),
-               jl_stderr_obj(),
-               jl_exception_occurred());
-      jl_printf(jl_stderr_stream(), "\n");
-    }
+    if (jl_exception_occurred())
+      jl_throw_exception();
     PL_fail;
   }
 #ifdef JURASSIC_DEBUG
@@ -1980,3 +4922,63 @@ foreign_t jl_embed_halt(void) {
   jl_atexit_hook(0);
   PL_succeed;
 }
+
+/* Counters and stage timers, see the "Performance counters and tracing" section */
+foreign_t jl_stats(term_t dict) {
+  return unify_stats(dict);
+}
+
+foreign_t jl_stats_reset(void) {
+  reset_stats();
+  PL_succeed;
+}
+
+foreign_t jl_stats_enable(term_t enable) {
+  int on;
+  if (!PL_get_bool_ex(enable, &on))
+    PL_fail;
+  if (on)
+    __atomic_fetch_or(&instrument, INSTRUMENT_STATS, __ATOMIC_RELAXED);
+  else
+    __atomic_fetch_and(&instrument, ~INSTRUMENT_STATS, __ATOMIC_RELAXED);
+  PL_succeed;
+}
+
+/* Trace events, see the "Performance counters and tracing" section */
+foreign_t jl_trace(term_t mode) {
+  char *m;
+  if (!PL_get_atom_chars(mode, &m))
+    return PL_type_error("atom", mode);
+  if (strcmp(m, "on") == 0)
+    __atomic_fetch_or(&instrument, INSTRUMENT_TRACE, __ATOMIC_RELAXED);
+  else if (strcmp(m, "off") == 0)
+    __atomic_fetch_and(&instrument, ~INSTRUMENT_TRACE, __ATOMIC_RELAXED);
+  else
+    return PL_domain_error("on_or_off", mode);
+  PL_succeed;
+}
+
+foreign_t jl_trace_dump(term_t file) {
+  char *path;
+  if (!PL_get_file_name(file, &path, PL_FILE_OSPATH))
+    PL_fail;
+  FILE *out = fopen(path, "w");
+  if (out == NULL)
+    return PL_existence_error("file", file);
+  dump_trace(out);
+  fclose(out);
+  PL_succeed;
+}
+
+/* Julia heap statistics and GC control, see "Julia garbage collection" */
+foreign_t jl_gc_stats(term_t dict) {
+  return unify_gc_stats(dict);
+}
+
+foreign_t jl_gc(term_t action) {
+  return gc_action(action);
+}
+
+foreign_t jl_gc_policy(term_t options) {
+  return set_gc_policy(options);
+}
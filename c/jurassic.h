@@ -9,6 +9,8 @@
 //#define JURASSIC_DEBUG
 
 #define BUFFSIZE 4096
+#define JURASSIC_MAX_DIMS 32 /* maximum dimensions of nested list arrays */
+#define JURASSIC_FRAME_CHUNK 256 /* elements converted per foreign frame */
 
 #define JURASSIC_SUCCESS 1
 #define JURASSIC_FAIL 0
@@ -16,8 +18,11 @@
 /* Convert Prolog atoms to Julia values. When an atom is a defined Julia variable,
    the "flag_sym" argument determines whether to return its symbol or its value. */
 int atom_to_jl(atom_t atom, jl_value_t **ret, int flag_sym);
-/* Convert Prolog lists to Julia arrays.
-   TODO: multi-dimension arrays */
+/* Convert Prolog lists to Julia arrays (Vector{Any}). Homogeneous and nested
+   lists are handled by pl_to_jl, which builds typed Vector{T}/Array{T,N}.
+   Nested lists are row-major: the outermost list is the first dimension, so
+   A[i,j] is the j-th element of the i-th sublist, while the Julia buffer is
+   filled column-major. */
 int list_to_jl(term_t list, jl_array_t **ret, int flag_sym);
 /* Convert prolog compounds to Julia expressions.
    FIXME: GC issues? */
@@ -41,6 +46,17 @@ int jl_set_args(jl_expr_t **ex, term_t expr, size_t arity, size_t start_jl, size
 install_t install_jurassic(void);
 foreign_t jl_eval_str(term_t jl_expr, term_t pl_ret);
 foreign_t jl_eval(term_t jl_expr, term_t pl_ret);
+foreign_t jl_eval_handle(term_t jl_expr, term_t handle);
+foreign_t jl_array_new(term_t name, term_t type, term_t init, term_t size);
+foreign_t jl_array_get(term_t array, term_t index, term_t value);
+foreign_t jl_array_set(term_t array, term_t index, term_t value);
+foreign_t jl_array_fill(term_t array, term_t value);
+foreign_t jl_array_slice(term_t array, term_t offset, term_t limit, term_t list);
+foreign_t jl_prepare_function(term_t body, term_t params, term_t handle);
+foreign_t jl_exec(term_t handle, term_t args, term_t result);
+foreign_t jl_batch(term_t goals, term_t results);
+foreign_t jl_map_lists(term_t func, term_t lists, term_t out, term_t mode);
+foreign_t jl_member(term_t x, term_t iterable, control_t handle);
 foreign_t jl_tuple_unify(term_t pl_tuple, term_t jl_expr);
 foreign_t jl_tuple_unify_str(term_t pl_tuple, term_t jl_expr_str);
 foreign_t jl_send_command_str(term_t jl_expr);
@@ -52,5 +68,13 @@ foreign_t jl_declare_function(term_t fname_pl, term_t fargs_pl, term_t fexprs_pl
 foreign_t jl_declare_macro_function(term_t mname_pl, term_t fname_pl, term_t fargs_pl, term_t fexprs_pl);
 foreign_t jl_embed_halt(void);
 foreign_t jl_type_name(term_t jl_expr, term_t type_name_term);
+foreign_t jl_gc_stats(term_t dict);
+foreign_t jl_gc(term_t action);
+foreign_t jl_gc_policy(term_t options);
+foreign_t jl_stats(term_t dict);
+foreign_t jl_stats_reset(void);
+foreign_t jl_stats_enable(term_t enable);
+foreign_t jl_trace(term_t mode);
+foreign_t jl_trace_dump(term_t file);
 
 #endif /* _JURASSIC_H */
@@ -0,0 +1,130 @@
+# Julia helpers of Jurassic.pl, loaded by install_jurassic unless the system
+# image already contains them (see `make sysimage`)
+module Jurassic
+
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# Mapping over lists
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# map on Julia threads, the result is narrowed to a concrete element type
+function tmap(f, xs...)
+    out = Vector{Any}(undef, length(xs[1]))
+    Threads.@threads for i in eachindex(out)
+        out[i] = f(map(x -> x[i], xs)...)
+    end
+    return identity.(out)
+end
+
+# index ranges of the chunks, a chunk size of 0 makes 4 chunks per thread
+function chunks(n::Integer, chunk::Integer)
+    chunk > 0 || (chunk = cld(n, 4 * Threads.nthreads()))
+    return collect(Iterators.partition(1:n, chunk))
+end
+
+# chunked map on Julia threads, the results keep the input order
+function pmap(f, chunk::Integer, xs...)
+    out = Vector{Any}(undef, length(xs[1]))
+    Threads.@threads for r in chunks(length(out), chunk)
+        for i in r
+            out[i] = f(map(x -> x[i], xs)...)
+        end
+    end
+    return identity.(out)
+end
+
+function pforeach(f, chunk::Integer, xs...)
+    Threads.@threads for r in chunks(length(xs[1]), chunk)
+        for i in r
+            f(map(x -> x[i], xs)...)
+        end
+    end
+    return nothing
+end
+
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# Producer streams
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# "src" is a function of the channel or an iterable that is pumped into it,
+# the task is spawned so it may run on another Julia thread
+function stream(src, capacity::Integer)
+    producer = src isa Function ? src : ch -> foreach(x -> put!(ch, x), src)
+    return Channel{Any}(producer, capacity; spawn = true)
+end
+
+# take up to n items, fewer only when the channel is closed
+function take(ch::Channel, n::Integer)
+    items = Any[]
+    for x in ch
+        push!(items, x)
+        length(items) >= n && break
+    end
+    return identity.(items)
+end
+
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# Batched evaluation
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# index of the first goal of jl_batch/2 whose global cannot be assigned,
+# 0 when all can: names[i] is the name of goal i or nothing, values[i] its
+# value. Constants, imported names and values of the wrong declared type
+# are rejected before any global is changed.
+function check_globals(names, values)
+    for (i, name) in enumerate(names)
+        name === nothing && continue
+        if isdefined(Main, name)
+            isconst(Main, name) && return i
+            Base.binding_module(Main, name) === Main || return i
+        end
+        if isdefined(Core, :get_binding_type)
+            values[i] isa Core.get_binding_type(Main, name) || return i
+        end
+    end
+    return 0
+end
+
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# Futures
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+spawn(thunk, threads::Bool) = threads ? Threads.@spawn(thunk()) : @async(thunk())
+
+# index and value of the first finished task, a failed task is finished too:
+# the watchers only report which task ended and fetch throws its
+# TaskFailedException
+function await_any(tasks)
+    i = findfirst(istaskdone, tasks)
+    if i === nothing
+        done = Channel{Int}(length(tasks))
+        for (k, t) in enumerate(tasks)
+            @async (try wait(t) catch end; put!(done, k))
+        end
+        i = take!(done)
+    end
+    return Any[i, fetch(tasks[i])]
+end
+
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# Precompilation
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# replay the precompile statements of a --trace-compile file, statements of
+# types that are not loaded are skipped, returns the number compiled
+function precompile_from(file::AbstractString)
+    n = 0
+    for line in eachline(file)
+        startswith(line, "precompile(") || continue
+        try
+            n += Core.eval(Main, Meta.parse(line)) === true
+        catch
+        end
+    end
+    return n
+end
+
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# Garbage collection
+# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+# number of collections and of full ones, for jl_gc_stats/1
+function gc_counts()
+    n = Base.gc_num()
+    return Int64[n.pause, n.full_sweep]
+end
+
+end
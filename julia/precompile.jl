@@ -0,0 +1,8 @@
+# Exercise the Jurassic helpers while the system image is traced
+include(joinpath(@__DIR__, "jurassic.jl"))
+
+Jurassic.tmap(sqrt, [1.0, 4.0])
+Jurassic.pmap(+, 0, [1, 2], [3, 4])
+Jurassic.pforeach(identity, 1, [1, 2])
+Jurassic.take(Jurassic.stream(1:10, 4), 5)
+Jurassic.await_any([Jurassic.spawn(() -> 1, true)])
@@ -0,0 +1,11 @@
+# Build a system image with the Jurassic helpers and user packages:
+#   julia julia/sysimage.jl lib/jurassic_sys.so [Package ...]
+using PackageCompiler
+
+sysimage_path = ARGS[1]
+packages = Symbol.(ARGS[2:end])
+
+create_sysimage(packages;
+                sysimage_path = sysimage_path,
+                script = joinpath(@__DIR__, "jurassic.jl"),
+                precompile_execution_file = joinpath(@__DIR__, "precompile.jl"))
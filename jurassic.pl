@@ -5,12 +5,51 @@
                      jl_send_command_str/1,
                      jl_eval/2,
                      jl_eval_str/2,
+                     jl_eval_handle/2,
                      jl_disp/1,
                      jl_show/1,
                      jl_tuple_unify_str/2,
                      jl_tuple_unify/2,
                      jl_isdefined/1,
                      jl_new_array/4,
+                     jl_array_new/4,
+                     jl_array_get/3,
+                     jl_array_set/3,
+                     jl_array_fill/2,
+                     jl_array_slice/4,
+                     jl_prepare/3,
+                     jl_exec/3,
+                     jl_batch/2,
+                     jl_maplist/3,
+                     jl_maplist/4,
+                     jl_maplist/5,
+                     jl_tmaplist/3,
+                     jl_tmaplist/4,
+                     jl_tmaplist/5,
+                     jl_pmap/3,
+                     jl_pmap/4,
+                     jl_pforeach/2,
+                     jl_pforeach/3,
+                     jl_member/2,
+                     jl_stream/2,
+                     jl_stream/3,
+                     jl_spawn/2,
+                     jl_spawn/3,
+                     jl_await/2,
+                     jl_ready/1,
+                     jl_await_any/3,
+                     jl_precompile_from/1,
+                     jl_precompile_from/2,
+                     jl_gc_stats/1,
+                     jl_gc/1,
+                     jl_gc_policy/1,
+                     jl_without_gc/1,
+                     jl_stats/1,
+                     jl_stats_reset/0,
+                     jl_stats_enable/1,
+                     jl_trace/1,
+                     jl_trace_dump/1,
+                     jl_error_message/2,
                      jl_declare_function/3,
                      jl_declare_macro_function/4,
                      jl_type_name/2, % type name is a string
@@ -43,35 +82,18 @@
                      op(50, fx, $)
                     ]).
 
+:- use_module(library(lazy_lists)).
+
 :-
     set_prolog_flag(rational_syntax, natural),
     set_prolog_flag(prefer_rationals, true).
 
 
+%% Kept for compatibility, has no effect: rectangular nested lists always
+%% become Array{T,N}, the outermost list is the first dimension. The flag
+%% it sets is not read anymore.
 jl_unify_arrays :-
-    set_prolog_flag(jl_use_multi_dim_arrays, true),
-    jl_send_command_str("module JurassicArrays
-export stack, unstack
-
-# recursively unstack an array
-unstack(a::Array) = begin
-    return map(unstack, map(Array, collect(eachslice(a, dims=1))))
-end
-unstack(vs::Vector{T}) where T<:Real = vs
-
-# Stacking nested vectors to array
-# source: https://discourse.julialang.org/t/how-to-convert-vector-of-vectors-to-matrix/72609/23
-unsqueeze(a::Array) = begin
-    nsize = foldl(append!, size(a); init=[1])
-    return reshape(a, Tuple(nsize))
-end
-
-stack(vs::Vector{T}) where T<:Vector = begin
-    return reduce(vcat, map(unsqueeze, map(stack, vs)))
-end
-stack(vs::Vector{T}) where T<:Real = vs
-
-end").
+    set_prolog_flag(jl_use_multi_dim_arrays, true).
 
 /* Unary */
 ':='(X) :-
@@ -84,28 +106,16 @@ end").
     % assign function returns to a tuple
     compound(Y), Y = tuple(Z),
     jl_tuple_unify(tuple(Z), X), !.
-% prolog lists to julia array
-':='(Y, array(X)) :-
-    current_prolog_flag(jl_use_multi_dim_arrays, true), % only runs when using multi-dimentional arrays
-    % assign function returns to a tuple
-    ground(Y),
-    is_list(X), !,    
-    Y := 'JurassicArrays.stack'(X).
 ':='(Y, X) :-
     ground(Y), !,
     := Y = X.
+% keep the result in Julia, Y is a handle to it
+':='(Y, handle(X)) :-
+    var(Y), !,
+    jl_eval_handle(X, Y).
 ':='(Y, str(X)) :-
     string(X), !,
     jl_eval_str(X, Y).
-% julia tensor to prolog lists
-':='(Y, X) :-
-    current_prolog_flag(jl_use_multi_dim_arrays, true), % only runs when using multi-dimentional arrays
-    % assign function returns to a tuple
-    jl_type_name(X, "Array"),
-    tuple(Size) := size(X),
-    length(Size, Dim),
-    Dim >= 2, !, % only handles matrices and tensors
-    Y := 'JurassicArrays.unstack'(X).
 ':='(Y, X) :-
     jl_eval(X, Y).
 /* Meta-programming: assign Julia variable Y with QuoteNode of X (without evaluation) */
@@ -115,10 +125,110 @@ end").
 
 /* array init */
 jl_new_array(Name, Type, Init, Size) :-
-    length(Size, Dim),
-    list_tuple(Size, Size_Tuple), !,
-    swritef(Str, '%w = Array{%w, %w}(%w, %w)', [Name, Type, Dim, Init, Size_Tuple]),
-    := Str.
+    jl_array_new(Name, Type, Init, Size).
+
+/* map Julia functions over lists in one call, jl_tmaplist uses Julia threads */
+jl_maplist(F, L, Out) :-
+    jl_map_lists(F, [L], Out, false).
+jl_maplist(F, L1, L2, Out) :-
+    jl_map_lists(F, [L1, L2], Out, false).
+jl_maplist(F, L1, L2, L3, Out) :-
+    jl_map_lists(F, [L1, L2, L3], Out, false).
+
+jl_tmaplist(F, L, Out) :-
+    jl_map_lists(F, [L], Out, true).
+jl_tmaplist(F, L1, L2, Out) :-
+    jl_map_lists(F, [L1, L2], Out, true).
+jl_tmaplist(F, L1, L2, L3, Out) :-
+    jl_map_lists(F, [L1, L2, L3], Out, true).
+
+/* chunked parallel map and foreach, results are in input order */
+jl_pmap(F, L, Out) :-
+    jl_pmap(F, L, Out, []).
+jl_pmap(F, L, Out, Options) :-
+    option(chunk(N), Options, 0),
+    jl_map_lists(F, [L], Out, chunk(N)).
+
+jl_pforeach(F, L) :-
+    jl_pforeach(F, L, []).
+jl_pforeach(F, L, Options) :-
+    option(chunk(N), Options, 0),
+    jl_map_lists(F, [L], _, foreach(N)).
+
+/* lazy list of the items produced by a Julia task into a bounded Channel */
+jl_stream(Expr, List) :-
+    jl_stream(Expr, List, []).
+jl_stream(Expr, List, Options) :-
+    option(chunk(N), Options, 64),
+    option(capacity(C), Options, 256),
+    must_be(positive_integer, N),
+    must_be(positive_integer, C),
+    Channel := handle('Jurassic.stream'(Expr, C)),
+    stream_list(Channel, N, List).
+
+/* lazy_list/2 caches every taken chunk in the list, so backtracking over a
+   consumer does not lose items; failing ends the list */
+stream_list(Channel, N, List) :-
+    lazy_list(stream_chunk(Channel, N), List).
+
+stream_chunk(Channel, N, List, Tail) :-
+    Items := 'Jurassic.take'(Channel, N),
+    Items \== [],
+    append(Items, Tail, List).
+
+/* futures, Expr runs as a Julia task and Future is a handle of the Task */
+jl_spawn(Expr, Future) :-
+    jl_spawn(Expr, Future, []).
+jl_spawn(Expr, Future, Options) :-
+    option(threads(Threads), Options, true),
+    must_be(boolean, Threads),
+    jl_prepare_function(Expr, [], Thunk),
+    Future := handle('Jurassic.spawn'(Thunk, Threads)).
+
+jl_await(Future, Result) :-
+    jl_eval(fetch(Future), Result).
+
+jl_ready(Future) :-
+    jl_eval(istaskdone(Future), true).
+
+jl_await_any(Futures, Which, Result) :-
+    jl_eval('Jurassic.await_any'(Futures), [I, Result]),
+    nth1(I, Futures, Which).
+
+/* replay the precompile statements recorded with the jl_trace_compile flag,
+   background(Future) replays them in a Julia task */
+jl_precompile_from(File) :-
+    jl_precompile_from(File, []).
+jl_precompile_from(File, Options) :-
+    absolute_file_name(File, Path, [access(read)]),
+    atom_string(Path, PathStr),
+    (   option(background(Future), Options)
+    ->  jl_spawn('Jurassic.precompile_from'(PathStr), Future)
+    ;   N := 'Jurassic.precompile_from'(PathStr),
+        option(count(N), Options, _)
+    ).
+
+/* run Goal with Julia's GC disabled, e.g. a latency-critical section */
+jl_without_gc(Goal) :-
+    jl_gc_stats(Stats),
+    get_dict(enabled, Stats, Enabled),
+    (   Enabled == true
+    ->  setup_call_cleanup(jl_gc(disable), Goal, jl_gc(enable))
+    ;   call(Goal)
+    ).
+
+/* prepared expressions, Params are the variables of Template */
+jl_prepare(Template, Params, Handle) :-
+    copy_term(Template-Params, Body-Vars),
+    bind_param_names(Vars, 1),
+    jl_prepare_function(Body, Vars, Handle).
+
+bind_param_names([], _).
+bind_param_names([V|Vs], N) :-
+    must_be(var, V),
+    atom_concat('#jl_arg', N, V),
+    N1 is N + 1,
+    bind_param_names(Vs, N1).
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
  Syntax
@@ -253,11 +363,6 @@ contains_inline(Term) :-
     ->  true
     ).
 
-%% Turn list to tuple
-list_tuple([A], (A)). 
-list_tuple([A,B|L], (A,R)) :-
-    list_tuple([B|L], R).
-
 user:goal_expansion(In, Out) :-
     contains_dot(In), !,
     expand_dotted_name(In, Out).
@@ -274,6 +379,10 @@ user:goal_expansion(In, Out) :-
     contains_inline(In),
     expand_inline_init(In, Out).
 
+%% Julia exceptions raise error(julia_error(Type, Handle), _) (error), are
+%% printed before failing (print) or fail silently (fail)
+:- create_prolog_flag(jl_error, error, [type(atom), keep(true)]).
+
 :- load_foreign_library("lib/jurassic.so").
 :- at_halt(halt_hooks).
 
@@ -283,6 +392,19 @@ halt_hooks :-
     unload_foreign_library("lib/jurassic.so"),
     writeln("Done").
 
+/* the showerror message of a Julia exception handle, formatted on demand */
+jl_error_message(Handle, Message) :-
+    Message := sprint(showerror, Handle).
+
+:- multifile prolog:error_message//1.
+
+prolog:error_message(julia_error(Type, Handle)) -->
+    {   catch(jl_error_message(Handle, Message), _, fail)
+    ->  true
+    ;   Message = ""
+    },
+    [ 'Julia ~w: ~s'-[Type, Message] ].
+
 /* display julia variable */
 jl_disp(X) :-
     := display(X), nl.
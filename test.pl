@@ -89,7 +89,47 @@
 :- a := array('Float64', undef, 2, 2, 2).
 :- := @show(a[1,:,:]).
 :- jl_new_array(a, 'Int', undef, [2, 2, 2]).
+:- jl_new_array(b, 'Union{Int64, Missing}', missing, [2]), jl_array_set(b, [1], 3), X := b, X == [3, missing].
+:- jl_new_array(b, "Vector{Float64}", undef, [1]), S := string(typeof(b)), atom_string(A, S), A == 'Vector{Vector{Float64}}'.
 :- := @show(a[1,:,:]).
 :- a := array(union('Int64', 'Missing'), missing, 2, 2).
 :- a[1, :] := [1,2].
 :- := @show(a).
+:- a := [1.0, 2.0, inf], := @show(typeof(a)).
+:- a := [1, missing, 3], := @show(typeof(a)).
+:- X = [[1,2],[3,4]], a := array(X), := display(a), Y := a, X == Y.
+:- X := zeros(2,3,2), length(X, 2), forall(member(R, X), (length(R, 3), forall(member(P, R), P == [0.0, 0.0]))).
+:- X = [[[1,2],[3,4],[5,6]],[[7,8],[9,10],[11,12]]], a := array(X), tuple([2, 3, 2]) := size(a), 4 := a[1,2,2], 11 := a[2,3,1], Y := a, Y == X.
+:- X := 'Float32'(1.5), Y := 'UInt8'(200), Z := 'Int128'(2)^100, C := 'Char'(97), X =:= 1.5, Y == 200, Z =:= 2^100, C == a.
+:- X := factorial(big(30)), Y := X // 7, Z := Y * 7, X == Z.
+:- M := handle(rand(100, 100)), S := sum(M), N := size(M, 1), writeln(S-N).
+:- jl_array_new(a, 'Float64', 0.0, [2, 3]), jl_array_set(a, [1, 2], 1.5),
+   jl_array_get(a, [1, 2], X), jl_array_get(a, 3, X),
+   jl_array_fill(a, 2.0), jl_array_slice(a, 1, 2, [2.0, 2.0]).
+:- jl_prepare(f(X) + Y, [X, Y], H), forall(between(1, 10, I), jl_exec(H, [I, 10], _)).
+:- jl_batch([b := 2.0, X := sqrt(b), := println(X)], [2.0, X, nothing]).
+:- jl_maplist(sqrt, [1, 4, 9], [1.0, 2.0, 3.0]), jl_tmaplist(+, [1, 2], [3, 4], [4, 6]).
+:- jl_member(X, 1:10^12), X > 3, !, findall(Y, jl_member(Y, [1, 2, 3]), [1, 2, 3]).
+:- jl_stream(1:200, L, [chunk(16)]), nth1(100, L, 100), length(L, 200).
+:- jl_spawn(sum(1:100), F), jl_await(F, 5050), jl_ready(F), jl_await_any([F], F, 5050).
+:- jl_pmap(x ->> x * 2, [1, 2, 3], [2, 4, 6], [chunk(2)]), jl_pforeach(identity, [1, 2]).
+:- tmp_file_stream(text, F, S), format(S, "precompile(Tuple{typeof(sin), Float64})~n", []), close(S), jl_precompile_from(F, [count(1)]).
+:- jl_stats_enable(true), jl_stats_reset, _ := sum([1, 2]), jl_stats(S), get_dict(calls, S, C), get_dict(jl_eval, C, N), N >= 1, jl_stats_enable(false).
+:- jl_trace(on), _ := sum([1, 2]), jl_trace(off), tmp_file(trace, F), jl_trace_dump(F), size_file(F, N), N > 0.
+:- catch(_ := sqrt(-1), error(julia_error('DomainError', E), _), true), jl_error_message(E, M), string(M).
+:- set_prolog_flag(jl_error, fail), \+ _ := sqrt(-1), set_prolog_flag(jl_error, error).
+:- jl_gc(collect(incremental)), jl_without_gc(_ := 1 + 1), jl_gc_stats(S), get_dict(enabled, S, true), jl_gc_policy([threshold(1000000)]), jl_gc_policy([]).
+:- numlist(1, 1000000, L), maplist([I, [I]]>>true, L, LL), N := length(LL), N == 1000000, tuple([A, _]) := extrema(L), A == 1.
+:- jl_declare_function(fresh_vec, [x], [[0, 0]]), a := fresh_vec(1), a[1] := 1, X := fresh_vec(1), X == [0, 0].
+:- jl_array_new(a, 'String', undef, [3]), catch(jl_array_get(a, 1, _), error(julia_error('UndefRefError', _), _), true), jl_array_set(a, 1, "x"), jl_array_get(a, 1, "x").
+:- n := 1, jl_batch([y := n, n := n + 1, m := 2 * n], [1, 2, 4]), 2 := n.
+:- catch(jl_batch([x := 1, := sqrt(-1)], _), error(julia_error(_, _), context(jl_batch/2, goal(2))), true).
+:- catch(jl_batch([sin := 3], _), E, true), E = error(permission_error(modify, julia_global, sin), context(jl_batch/2, goal(1))).
+:- x := 1, catch(jl_batch([x := 2, := sqrt(-1)], _), error(julia_error(_, _), _), true), 1 := x.
+:- := cmd("global batch_typed::Int64 = 0"), x := 1, catch(jl_batch([x := 2, batch_typed := "s"], _), E, true), E = error(permission_error(modify, julia_global, batch_typed), _), 1 := x.
+:- catch(jl_batch([X := 1, X := 2], _), E, true), E = error(uninstantiation_error(_), context(jl_batch/2, goal(2))).
+:- catch(jl_batch([f(1) := 2], _), E, true), E = error(domain_error(jl_batch_goal, f(1) := 2), context(jl_batch/2, goal(1))).
+:- set_prolog_flag(jl_error, fail), \+ jl_batch([f(1) := 2], _), set_prolog_flag(jl_error, error).
+:- set_prolog_flag(jl_error, fail), \+ := sqrt(-1), set_prolog_flag(jl_error, error), catch(_ := error("x"), error(julia_error(_, _), _), true).
+:- jl_spawn(error("boom"), F), catch(jl_await(F, _), error(julia_error('TaskFailedException', _), _), true), catch(jl_await_any([F], _, _), error(julia_error('TaskFailedException', _), _), true).
+:- jl_stream(1:100, L, [chunk(8)]), \+ L = [0|_], once((member(X, L), X > 20)), numlist(1, 100, L).